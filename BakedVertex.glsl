@@ -0,0 +1,20 @@
+#version 140
+in vec2 grid_pos;
+out float distance;
+uniform samplerBuffer tiles;
+uniform sampler2DArray heights;
+uniform int tile_base;
+uniform int layer;
+uniform mat4 world_mat;
+uniform mat4 view_mat;
+uniform mat4 proj_mat;
+void main()
+{
+    vec2 origin = texelFetch(tiles, tile_base).xy;
+    vec4 pos = world_mat * vec4(origin.x + grid_pos.x, 0.f,
+                                origin.y + grid_pos.y, 1.f);
+    pos.y = texelFetch(heights, ivec3(grid_pos, layer), 0).r;
+    pos = view_mat * pos;
+    distance = length(pos.xyz);
+    gl_Position = proj_mat * pos;
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+#version 140
+in vec3 corner;
+uniform vec3 bounds_min;
+uniform vec3 bounds_max;
+uniform mat4 view_projection;
+void main()
+{
+    gl_Position = view_projection * vec4(mix(bounds_min, bounds_max, corner),
+                                         1.f);
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 140
+in vec3 position;
+out float distance;
+uniform mat4 view_mat;
+uniform mat4 proj_mat;
+void main()
+{
+    vec4 pos = view_mat * vec4(position, 1.f);
+    distance = length(pos.xyz);
+    gl_Position = proj_mat * pos;
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 430
+layout(local_size_x = BAKE_GROUP, local_size_y = BAKE_GROUP) in;
+float Height(vec2 pos);
+layout(r32f) writeonly uniform image2DArray heights;
+uniform ivec3 requests[BAKE_BATCH];
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if(texel.x > TILE_SIZE || texel.y > TILE_SIZE) return;
+    ivec3 request = requests[gl_WorkGroupID.z];
+    vec2 pos = vec2(request.xy * TILE_SIZE + texel);
+    imageStore(heights, ivec3(texel, request.z), vec4(Height(pos)));
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#version 140
+in vec2 fuv;
+in vec4 vcolor;
+out vec4 fcolor;
+uniform sampler2D font;
+void main()
+{
+    fcolor = vec4(vcolor.rgb, vcolor.a * texelFetch(font, ivec2(fuv), 0).r);
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+#version 140
+in vec2 position;
+in vec2 uv;
+in vec4 color;
+out vec2 fuv;
+out vec4 vcolor;
+uniform vec2 screen;
+void main()
+{
+    fuv = uv;
+    vcolor = color;
+    gl_Position = vec4(position / screen * vec2(2.f, -2.f) + vec2(-1.f, 1.f),
+                       0.f, 1.f);
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+#version 140
+in vec3 direction;
+out vec3 fcolor;
+uniform samplerCube panorama;
+void main()
+{
+    fcolor = texture(panorama, direction).rgb;
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#version 140
+in vec3 corner;
+out vec3 direction;
+uniform mat4 view_projection;
+void main()
+{
+    direction = corner;
+    gl_Position = (view_projection * vec4(corner, 1.f)).xyww;
+}
\ No newline at end of file
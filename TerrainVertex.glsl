@@ -2,13 +2,21 @@
 float Height(vec2 pos);
 in vec2 grid_pos;
 out float distance;
+uniform samplerBuffer tiles;
+uniform int tile_base;
 uniform mat4 world_mat;
 uniform mat4 view_mat;
 uniform mat4 proj_mat;
 void main()
 {
-    vec4 pos = world_mat * vec4(grid_pos.x, 0.f,
-                                grid_pos.y, 1.f);
+#ifdef TERRAIN_DRAW_ID
+    int tile = tile_base + gl_DrawIDARB;
+#else
+    int tile = tile_base + gl_InstanceID;
+#endif
+    vec2 origin = texelFetch(tiles, tile).xy;
+    vec4 pos = world_mat * vec4(origin.x + grid_pos.x, 0.f,
+                                origin.y + grid_pos.y, 1.f);
     pos.y = Height(pos.xz);
     pos = view_mat * pos;
     distance = length(pos.xyz);
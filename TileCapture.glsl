@@ -0,0 +1,10 @@
+#version 140
+float Height(vec2 pos);
+in vec2 grid_pos;
+out vec3 position;
+uniform vec2 origin;
+void main()
+{
+    position = vec3(origin.x + grid_pos.x, 0.f, origin.y + grid_pos.y);
+    position.y = Height(position.xz);
+}
\ No newline at end of file
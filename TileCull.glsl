@@ -0,0 +1,42 @@
+#version 430
+layout(local_size_x = 64) in;
+struct DrawElementsIndirectCommand
+{
+    uint count;
+    uint instance_count;
+    uint first_index;
+    int base_vertex;
+    uint base_instance;
+};
+layout(std430, binding = 0) readonly buffer Candidates
+{
+    vec4 bounds[];
+};
+layout(std430, binding = 1) buffer Command
+{
+    DrawElementsIndirectCommand command;
+};
+layout(std430, binding = 2) writeonly buffer Visible
+{
+    vec2 origins[];
+};
+uniform vec4 planes[6];
+uniform vec3 camera;
+uniform float viewdistance;
+uniform uint candidate_count;
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= candidate_count) return;
+    vec3 bmin = bounds[2*i].xyz;
+    vec3 bmax = bounds[2*i+1].xyz;
+    vec2 d = max(max(bmin.xz - camera.xz, 0.f), camera.xz - bmax.xz);
+    if(length(d) > viewdistance) return;
+    for(int j = 0; j < 6; j++)
+    {
+        vec3 p = mix(bmin, bmax, greaterThan(planes[j].xyz, vec3(0.f)));
+        if(dot(planes[j].xyz, p) + planes[j].w < 0.f) return;
+    }
+    uint slot = atomicAdd(command.instance_count, 1u);
+    origins[slot] = bmin.xz;
+}
\ No newline at end of file
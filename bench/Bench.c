@@ -0,0 +1,408 @@
+/*
+ * Microbenchmarks of the CPU side hot paths. Built and run by make bench,
+ * from the repository root so settings.ini is found. Each case is run a few
+ * times to warm up, then timed over several repetitions, and the median
+ * time per operation is reported with the spread of the repetitions.
+ * First, the node hierarchy is checked against a plain recursive
+ * computation on a random tree.
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <linmath.h>
+#include "../src/Noise.h"
+#include "../src/Grid.h"
+#include "../src/Node.h"
+#include "../src/Settings.h"
+#include "../src/Log.h"
+
+#define BENCH_WARMUP 3
+#define BENCH_REPETITIONS 15
+#define BENCH_POINTS 4096 //Points per noise run
+#define BENCH_NODES 37449 //Nodes in a tree of fanout 8 and depth 6
+#define CHECK_NODES 1000 //Nodes in the random tree of the hierarchy check
+#define CHECK_ROUNDS 20 //Rounds of random changes in the hierarchy check
+
+typedef struct
+{
+    const char* name;
+    void (*run)(int param);
+    int param;
+    int operations; //Per run, to report time per operation
+} Case;
+
+static volatile float sink;
+static float points[2*BENCH_POINTS];
+static float grid[2*129*129];
+static unsigned int indices[2*128 + 2*128*129];
+static Hierarchy hierarchy;
+static Node* nodes;
+static mat4x4 matrices[1024];
+static quat quats[1024];
+
+//Settings.c reports invalid values through this.
+void Log(LogLevel level, const char* format, ...)
+{
+    (void)level;
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+static double Now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+static void NoiseScalar(int octaves)
+{
+    float sum = 0.f;
+    int i;
+    for(i = 0; i < BENCH_POINTS; i++)
+    {
+        sum += Noise(octaves, points[2*i], points[2*i+1], 5.f, 0.001f, 0.f,
+                     20.f);
+    }
+    sink = sum;
+}
+
+static void NoiseSIMD(int octaves)
+{
+    float sum = 0.f;
+    int i, j;
+    for(i = 0; i < BENCH_POINTS; i += 4)
+    {
+        float x[4], y[4], out[4];
+        for(j = 0; j < 4; j++)
+        {
+            x[j] = points[2*(i+j)];
+            y[j] = points[2*(i+j)+1];
+        }
+        Noise4(octaves, x, y, 5.f, 0.001f, 0.f, 20.f, out);
+        sum += out[0] + out[1] + out[2] + out[3];
+    }
+    sink = sum;
+}
+
+static void GridVertices(int n)
+{
+    FillGridVertices(grid, n, 1);
+    sink = grid[2*n*n - 1];
+}
+
+static void GridIndices(int n)
+{
+    FillGridIndices(indices, n);
+    sink = indices[GridIndexCount(n) - 1];
+}
+
+//Moves the root back and forth, so the whole tree is updated every run.
+static void UpdateTree(int count)
+{
+    static int flip;
+    flip = !flip;
+    SetNodeTranslation(&nodes[0], (vec3){ flip ? 2.f : 1.f, 0.f, 0.f });
+    UpdateNode(&nodes[0]);
+    sink = GetNodePosition(&nodes[count - 1])[0];
+}
+
+//Moves the last leaf back and forth before each of count updates.
+static void UpdateLeaf(int count)
+{
+    int i;
+    for(i = 0; i < count; i++)
+    {
+        SetNodeTranslation(&nodes[BENCH_NODES - 1],
+                           (vec3){ i & 1 ? 2.f : 1.f, 0.f, 0.f });
+        UpdateNode(&nodes[0]);
+    }
+    sink = GetNodePosition(&nodes[BENCH_NODES - 1])[0];
+}
+
+//Updates count times without moving anything.
+static void UpdateStill(int count)
+{
+    int i;
+    for(i = 0; i < count; i++) UpdateNode(&nodes[0]);
+    sink = GetNodePosition(&nodes[BENCH_NODES - 1])[0];
+}
+
+static void MatrixMultiply(int count)
+{
+    mat4x4 r;
+    int i;
+    mat4x4_identity(r);
+    for(i = 0; i < count; i++) mat4x4_mul(r, matrices[i & 1023], r);
+    sink = r[3][3];
+}
+
+static void QuatMultiply(int count)
+{
+    //quat_mul can't write to an operand, so alternate between two.
+    quat r[2];
+    int i;
+    quat_identity(r[0]);
+    for(i = 0; i < count; i++) quat_mul(r[~i & 1], quats[i & 1023], r[i & 1]);
+    sink = r[count & 1][3];
+}
+
+static void LoadSettings(int param)
+{
+    (void)param;
+    Settings settings;
+    ConstructSettings(&settings);
+    LoadSettingsFile(&settings, "settings.ini");
+    sink = settings.graphics.viewdistance;
+}
+
+//Links count nodes into a tree where node i is the parent of 8i+1 to 8i+8.
+static void BuildTree(int count)
+{
+    int i;
+    DestroyHierarchy(&hierarchy);
+    for(i = 0; i < count; i++)
+    {
+        quat rotation;
+        quat_rotate(rotation, 0.01f*i, (vec3){ 0.f, 1.f, 0.f });
+        ConstructNode(&nodes[i], &hierarchy);
+        SetNodeRotation(&nodes[i], rotation);
+        SetNodeTranslation(&nodes[i], (vec3){ 1.f, 0.f, 0.f });
+        if(i > 0) AddChildNode(&nodes[(i-1)/8], &nodes[i]);
+    }
+}
+
+static void BuildChain(int count)
+{
+    int i;
+    DestroyHierarchy(&hierarchy);
+    for(i = 0; i < count; i++)
+    {
+        quat rotation;
+        quat_rotate(rotation, 0.01f, (vec3){ 0.f, 1.f, 0.f });
+        ConstructNode(&nodes[i], &hierarchy);
+        SetNodeRotation(&nodes[i], rotation);
+        SetNodeTranslation(&nodes[i], (vec3){ 1.f, 0.f, 0.f });
+        if(i > 0) AddChildNode(&nodes[i-1], &nodes[i]);
+    }
+}
+
+//World transforms of a node computed from the root down, for reference.
+static void ReferenceTransform(int id, const int* parents, quat* rotations,
+                               vec3* translations, mat4x4 world,
+                               quat orientation, vec3 position)
+{
+    mat4x4 local;
+    mat4x4_from_quat(local, rotations[id]);
+    mat4x4_translate_in_place(local, translations[id][0],
+                              translations[id][1], translations[id][2]);
+    int j;
+    if(parents[id] < 0)
+    {
+        mat4x4_dup(world, local);
+        for(j = 0; j < 4; j++) orientation[j] = rotations[id][j];
+        for(j = 0; j < 3; j++) position[j] = translations[id][j];
+        return;
+    }
+    mat4x4 parent_world;
+    quat parent_orientation;
+    vec3 parent_position, offset;
+    ReferenceTransform(parents[id], parents, rotations, translations,
+                       parent_world, parent_orientation, parent_position);
+    mat4x4_mul(world, parent_world, local);
+    quat_mul(orientation, parent_orientation, rotations[id]);
+    quat_mul_vec3(offset, parent_orientation, translations[id]);
+    vec3_add(position, parent_position, offset);
+}
+
+static float RandomFloat(float min, float max)
+{
+    return min + rand() / (float)RAND_MAX * (max - min);
+}
+
+/*
+ * Builds a random tree, with parents added after their children and nodes
+ * moved to other parents, then changes random nodes over several rounds.
+ * After each round, compares every world matrix and position with the
+ * reference. Returns the number of mismatching nodes.
+ */
+static int CheckHierarchy()
+{
+    Hierarchy h;
+    Node* check = malloc(CHECK_NODES*sizeof(Node));
+    int* parents = malloc(CHECK_NODES*sizeof(int));
+    quat* rotations = malloc(CHECK_NODES*sizeof(quat));
+    vec3* translations = malloc(CHECK_NODES*sizeof(vec3));
+    int i, j, k, round, errors = 0;
+    ConstructHierarchy(&h);
+    for(i = 0; i < CHECK_NODES; i++)
+    {
+        ConstructNode(&check[i], &h);
+        parents[i] = -1;
+    }
+    for(round = 0; round <= CHECK_ROUNDS && errors == 0; round++)
+    {
+        //The first round sets every node, later ones a few.
+        int changes = round == 0 ? CHECK_NODES : CHECK_NODES / 20;
+        for(k = 0; k < changes; k++)
+        {
+            i = round == 0 ? k : rand() % CHECK_NODES;
+            quat_rotate(rotations[i], RandomFloat(-3.f, 3.f),
+                        (vec3){ RandomFloat(-1.f, 1.f), 1.f,
+                                RandomFloat(-1.f, 1.f) });
+            for(j = 0; j < 3; j++)
+                translations[i][j] = RandomFloat(-1.f, 1.f);
+            SetNodeRotation(&check[i], rotations[i]);
+            SetNodeTranslation(&check[i], translations[i]);
+            int parent = rand() % (CHECK_NODES + 1) - 1;
+            if(rand() % 4 == 0) continue; //Keep the parent
+            if(SetHierarchyParent(&h, check[i].id,
+                                  parent >= 0 ? check[parent].id : -1) == 0)
+                parents[i] = parent;
+        }
+        UpdateNode(&check[0]);
+        for(i = 0; i < CHECK_NODES; i++)
+        {
+            mat4x4 world;
+            quat orientation;
+            vec3 position;
+            ReferenceTransform(i, parents, rotations, translations, world,
+                               orientation, position);
+            vec4* node_world = GetNodeWorldMatrix(&check[i]);
+            float* node_orientation = GetNodeOrientation(&check[i]);
+            float* node_position = GetNodePosition(&check[i]);
+            float error = 0.f;
+            for(j = 0; j < 16; j++)
+                error = fmaxf(error, fabsf(node_world[j/4][j%4] -
+                                           world[j/4][j%4]));
+            for(j = 0; j < 4; j++)
+                error = fmaxf(error, fabsf(node_orientation[j] -
+                                           orientation[j]));
+            for(j = 0; j < 3; j++)
+                error = fmaxf(error, fabsf(node_position[j] - position[j]));
+            if(error > 1e-3f) errors++;
+        }
+    }
+    DestroyHierarchy(&h);
+    free(translations);
+    free(rotations);
+    free(parents);
+    free(check);
+    return errors;
+}
+
+static int CompareDouble(const void* a, const void* b)
+{
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+/*
+ * Prints the median nanoseconds per operation, and the spread as the
+ * median absolute deviation relative to the median.
+ */
+static void RunCase(Case* c)
+{
+    double times[BENCH_REPETITIONS], deviations[BENCH_REPETITIONS];
+    int i;
+    for(i = 0; i < BENCH_WARMUP; i++) c->run(c->param);
+    for(i = 0; i < BENCH_REPETITIONS; i++)
+    {
+        double start = Now();
+        c->run(c->param);
+        times[i] = (Now() - start) * 1e9 / c->operations;
+    }
+    qsort(times, BENCH_REPETITIONS, sizeof(double), CompareDouble);
+    double median = times[BENCH_REPETITIONS/2];
+    for(i = 0; i < BENCH_REPETITIONS; i++)
+        deviations[i] = times[i] > median ? times[i] - median :
+                                            median - times[i];
+    qsort(deviations, BENCH_REPETITIONS, sizeof(double), CompareDouble);
+    double mad = deviations[BENCH_REPETITIONS/2];
+    printf("%-28s %6d %14.2f %7.2f%% %14.2f %14.2f\n", c->name, c->param,
+           median, 100.*mad/median, times[0], times[BENCH_REPETITIONS-1]);
+}
+
+int main()
+{
+    int i;
+    srand(1);
+    for(i = 0; i < 2*BENCH_POINTS; i++)
+        points[i] = (rand() / (float)RAND_MAX - 0.5f) * 100000.f;
+    for(i = 0; i < 1024; i++)
+    {
+        quat_rotate(quats[i], 0.001f*i, (vec3){ 0.f, 1.f, 0.f });
+        mat4x4_from_quat(matrices[i], quats[i]);
+    }
+    ConstructHierarchy(&hierarchy);
+    nodes = malloc(BENCH_NODES*sizeof(Node));
+
+    Case noise[] =
+    {
+        { "Noise scalar", NoiseScalar, 1, BENCH_POINTS },
+        { "Noise scalar", NoiseScalar, 4, BENCH_POINTS },
+        { "Noise scalar", NoiseScalar, 8, BENCH_POINTS },
+        { "Noise scalar", NoiseScalar, 16, BENCH_POINTS },
+        { "Noise SIMD", NoiseSIMD, 1, BENCH_POINTS },
+        { "Noise SIMD", NoiseSIMD, 4, BENCH_POINTS },
+        { "Noise SIMD", NoiseSIMD, 8, BENCH_POINTS },
+        { "Noise SIMD", NoiseSIMD, 16, BENCH_POINTS }
+    };
+    Case grids[] =
+    {
+        { "FillGridVertices", GridVertices, 33, 33*33 },
+        { "FillGridVertices", GridVertices, 129, 129*129 },
+        { "FillGridIndices", GridIndices, 33, 2*32 + 2*32*33 },
+        { "FillGridIndices", GridIndices, 129, 2*128 + 2*128*129 }
+    };
+    Case math[] =
+    {
+        { "mat4x4_mul", MatrixMultiply, 100000, 100000 },
+        { "quat_mul", QuatMultiply, 100000, 100000 }
+    };
+    Case tree = { "UpdateNode tree", UpdateTree, BENCH_NODES, BENCH_NODES };
+    Case chain = { "UpdateNode chain", UpdateTree, 4096, 4096 };
+    //Single updates take well under a microsecond, so each run repeats them
+    //for about a millisecond.
+    Case leaf = { "UpdateNode leaf moved", UpdateLeaf, 10000, 10000 };
+    Case still = { "UpdateNode nothing moved", UpdateStill, 400000, 400000 };
+    Case settings = { "LoadSettingsFile", LoadSettings, 0, 1 };
+
+    int errors = CheckHierarchy();
+    if(errors > 0)
+    {
+        printf("Hierarchy check failed, %d nodes differ from the reference.\n",
+               errors);
+        return 1;
+    }
+    printf("%-28s %6s %14s %8s %14s %14s\n", "case", "param", "median ns/op",
+           "spread", "min ns/op", "max ns/op");
+    for(i = 0; i < (int)(sizeof(noise)/sizeof(Case)); i++) RunCase(&noise[i]);
+    for(i = 0; i < (int)(sizeof(grids)/sizeof(Case)); i++) RunCase(&grids[i]);
+    BuildTree(BENCH_NODES);
+    RunCase(&tree);
+    RunCase(&leaf);
+    RunCase(&still);
+    BuildChain(chain.param);
+    RunCase(&chain);
+    for(i = 0; i < (int)(sizeof(math)/sizeof(Case)); i++) RunCase(&math[i]);
+    FILE* f = fopen("settings.ini", "r");
+    if(f)
+    {
+        fclose(f);
+        RunCase(&settings);
+    }
+    else
+    {
+        printf("%-28s skipped, no settings.ini here\n", settings.name);
+    }
+    DestroyHierarchy(&hierarchy);
+    free(nodes);
+    return 0;
+}
@@ -0,0 +1,341 @@
+#include "Benchmark.h"
+#include "PT.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define DEGREES ((float)M_PI / 180.f)
+
+/*
+ * Reads keyframes, one per line as time in seconds, x, y and z, then yaw and
+ * pitch in degrees. Empty lines and lines starting with # are skipped.
+ */
+static int LoadKeyframes(Benchmark* benchmark, const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if(!f) return -1;
+    int capacity = 16;
+    benchmark->keyframes = malloc(capacity*sizeof(Keyframe));
+    benchmark->keyframe_count = 0;
+    char line[256];
+    int number = 0;
+    while(fgets(line, sizeof(line), f))
+    {
+        number++;
+        char* start = line + strspn(line, " \t");
+        if(*start == '#' || *start == '\n' || *start == '\r' || !*start)
+            continue;
+        Keyframe k;
+        if(sscanf(start, "%f %f %f %f %f %f", &k.time, &k.position[0],
+                  &k.position[1], &k.position[2], &k.yaw, &k.pitch) != 6 ||
+           (benchmark->keyframe_count > 0 &&
+            k.time <= benchmark->keyframes[benchmark->keyframe_count-1].time))
+        {
+            fclose(f);
+            free(benchmark->keyframes);
+            return -number - 1;
+        }
+        k.yaw *= DEGREES;
+        k.pitch *= DEGREES;
+        if(benchmark->keyframe_count == capacity)
+        {
+            capacity *= 2;
+            benchmark->keyframes = realloc(benchmark->keyframes,
+                                           capacity*sizeof(Keyframe));
+        }
+        benchmark->keyframes[benchmark->keyframe_count++] = k;
+    }
+    fclose(f);
+    if(benchmark->keyframe_count < 2)
+    {
+        free(benchmark->keyframes);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Loads the flight path. Returns -1 if the file can't be read or has fewer
+ * than two keyframes, or -(line + 1) for a malformed or out of order
+ * keyframe. gpu must begin its frames before BeginBenchmarkFrame.
+ */
+int ConstructBenchmark(Benchmark* benchmark, const char* path,
+                       GpuProfiler* gpu)
+{
+    int err = LoadKeyframes(benchmark, path);
+    if(err < 0) return err;
+    float duration = benchmark->keyframes[benchmark->keyframe_count-1].time -
+                     benchmark->keyframes[0].time;
+    benchmark->frame_count = (int)ceilf(duration / BENCHMARK_STEP) + 1;
+    benchmark->frame = -BENCHMARK_WARMUP;
+    benchmark->samples = malloc(benchmark->frame_count*
+                                sizeof(BenchmarkSample));
+    benchmark->gpu = gpu;
+    benchmark->gpu_start = 0;
+    return 0;
+}
+
+static float CatmullRom(float p0, float p1, float p2, float p3, float t)
+{
+    return 0.5f*(2.f*p1 + (p2 - p0)*t +
+                 (2.f*p0 - 5.f*p1 + 4.f*p2 - p3)*t*t +
+                 (3.f*p1 - p0 - 3.f*p2 + p3)*t*t*t);
+}
+
+/*
+ * Moves the camera to where it is on the path in the next frame. Returns 0
+ * when the path has been flown.
+ */
+int UpdateBenchmark(Benchmark* benchmark, Camera* camera)
+{
+    if(benchmark->frame >= benchmark->frame_count) return 0;
+    Keyframe* k = benchmark->keyframes;
+    int n = benchmark->keyframe_count;
+    float time = k[0].time;
+    if(benchmark->frame > 0) time += benchmark->frame * BENCHMARK_STEP;
+    int i = 0;
+    while(i < n - 2 && time >= k[i+1].time) i++;
+    float t = (time - k[i].time) / (k[i+1].time - k[i].time);
+    if(t > 1.f) t = 1.f;
+    Keyframe* k0 = &k[i > 0 ? i - 1 : i];
+    Keyframe* k1 = &k[i];
+    Keyframe* k2 = &k[i+1];
+    Keyframe* k3 = &k[i < n - 2 ? i + 2 : i + 1];
+    vec3 translation;
+    int j;
+    for(j = 0; j < 3; j++)
+    {
+        translation[j] =
+            CatmullRom(k0->position[j], k1->position[j], k2->position[j],
+                       k3->position[j], t);
+    }
+    SetNodeTranslation(&camera->node, translation);
+    camera->yaw = CatmullRom(k0->yaw, k1->yaw, k2->yaw, k3->yaw, t);
+    camera->pitch = CatmullRom(k0->pitch, k1->pitch, k2->pitch, k3->pitch, t);
+    return 1;
+}
+
+//Copies the GPU profiler's results of a frame to its sample, once read.
+static void CollectGpuFrame(Benchmark* benchmark, long frame)
+{
+    const GpuFrame* f = GetGpuFrame(benchmark->gpu, frame);
+    long i = frame - benchmark->gpu_start;
+    if(!f || benchmark->frame < 0 || i < 0 || i >= benchmark->frame_count)
+        return;
+    BenchmarkSample* sample = &benchmark->samples[i];
+    sample->gputime = f->time;
+    sample->vertices = f->vertices;
+    sample->invocations = f->invocations;
+    int j;
+    for(j = 0; j < GPU_PROFILER_PASSES; j++)
+        sample->passes[j] = f->passes[j].time;
+}
+
+//Starts measuring a frame. Call before any GL work of the frame.
+void BeginBenchmarkFrame(Benchmark* benchmark)
+{
+    benchmark->cpu_start = SDL_GetPerformanceCounter();
+    if(benchmark->frame < 0) return;
+    if(benchmark->frame == 0) benchmark->gpu_start = benchmark->gpu->frame;
+    BenchmarkSample* sample = &benchmark->samples[benchmark->frame];
+    sample->gputime = -1.f;
+    sample->vertices = sample->invocations = -1.;
+    sample->tiles = -1.;
+    sample->tiletime = -1.f;
+    int i;
+    for(i = 0; i < GPU_PROFILER_PASSES; i++) sample->passes[i] = -1.f;
+    CollectGpuFrame(benchmark, benchmark->gpu->last_frame);
+}
+
+//Stops measuring the frame's CPU work. Call before swapping buffers.
+void EndBenchmarkFrame(Benchmark* benchmark)
+{
+    if(benchmark->frame < 0) return;
+    benchmark->samples[benchmark->frame].cputime =
+        (SDL_GetPerformanceCounter() - benchmark->cpu_start) /
+        (float)SDL_GetPerformanceFrequency();
+}
+
+/*
+ * Records the terrain tiles generated in the frame and the CPU time it
+ * took in seconds, either negative where the terrain doesn't cache tiles or
+ * the time isn't known.
+ */
+void RecordBenchmarkTiles(Benchmark* benchmark, int tiles, float time)
+{
+    if(benchmark->frame < 0) return;
+    benchmark->samples[benchmark->frame].tiles = tiles;
+    benchmark->samples[benchmark->frame].tiletime = time;
+}
+
+/*
+ * Records the time since the last frame was presented and moves on to the
+ * next frame.
+ */
+void FinishBenchmarkFrame(Benchmark* benchmark, float frametime)
+{
+    if(benchmark->frame >= 0)
+        benchmark->samples[benchmark->frame].frametime = frametime;
+    benchmark->frame++;
+}
+
+typedef struct
+{
+    double min, mean, p50, p95, p99, max;
+} Statistics;
+
+static int CompareDouble(const void* a, const void* b)
+{
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+//Summarizes count values, scaled by scale. Negative values mean unsupported.
+static Statistics Summarize(double* values, int count, double scale)
+{
+    Statistics s;
+    qsort(values, count, sizeof(double), CompareDouble);
+    if(count == 0 || values[0] < 0.)
+    {
+        s.min = s.mean = s.p50 = s.p95 = s.p99 = s.max = -1.;
+        return s;
+    }
+    double sum = 0.;
+    int i;
+    for(i = 0; i < count; i++) sum += values[i];
+    s.min = values[0]*scale;
+    s.mean = sum/count*scale;
+    s.p50 = values[(int)(0.5*(count - 1))]*scale;
+    s.p95 = values[(int)(0.95*(count - 1))]*scale;
+    s.p99 = values[(int)(0.99*(count - 1))]*scale;
+    s.max = values[count-1]*scale;
+    return s;
+}
+
+static void PrintStatistics(const char* name, Statistics* s)
+{
+    if(s->min < 0.)
+    {
+        printf("%-16s unavailable\n", name);
+        return;
+    }
+    printf("%-16s %12.3f %12.3f %12.3f %12.3f %12.3f %12.3f\n", name,
+           s->min, s->mean, s->p50, s->p95, s->p99, s->max);
+}
+
+static void WriteStatistics(FILE* f, const char* name, Statistics* s,
+                            char last)
+{
+    fprintf(f, "    \"%s\": { \"min\": %.6f, \"mean\": %.6f, \"p50\": %.6f, "
+               "\"p95\": %.6f, \"p99\": %.6f, \"max\": %.6f }%s\n",
+            name, s->min, s->mean, s->p50, s->p95, s->p99, s->max,
+            last ? "" : ",");
+}
+
+//Writes a JSON string, escaping quotes, backslashes and control characters.
+static void WriteString(FILE* f, const char* s)
+{
+    fputc('"', f);
+    for(; *s; s++)
+    {
+        unsigned char c = *s;
+        if(c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if(c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+/*
+ * Prints a summary of the recorded frames, and writes it to
+ * benchmark.json and the individual frames to benchmark.csv. Times are in
+ * milliseconds. description says what was measured, e.g. the settings.
+ */
+void ReportBenchmark(Benchmark* benchmark, const char* description)
+{
+    int i, count = benchmark->frame < benchmark->frame_count ?
+                   benchmark->frame : benchmark->frame_count;
+    if(count <= 0) return;
+    FlushGpuProfiler(benchmark->gpu);
+    long frame;
+    for(frame = benchmark->gpu->frame - GPU_PROFILER_LATENCY;
+        frame < benchmark->gpu->frame; frame++)
+    {
+        CollectGpuFrame(benchmark, frame);
+    }
+
+    double* values = malloc(count*sizeof(double));
+    Statistics stats[7];
+    const char* names[7] =
+    {
+        "frametime", "cputime", "gputime", "vertices", "invocations",
+        "tiles", "tiletime"
+    };
+    for(i = 0; i < count; i++) values[i] = benchmark->samples[i].frametime;
+    stats[0] = Summarize(values, count, 1000.);
+    for(i = 0; i < count; i++) values[i] = benchmark->samples[i].cputime;
+    stats[1] = Summarize(values, count, 1000.);
+    for(i = 0; i < count; i++) values[i] = benchmark->samples[i].gputime;
+    stats[2] = Summarize(values, count, 1000.);
+    for(i = 0; i < count; i++) values[i] = benchmark->samples[i].vertices;
+    stats[3] = Summarize(values, count, 1.);
+    for(i = 0; i < count; i++) values[i] = benchmark->samples[i].invocations;
+    stats[4] = Summarize(values, count, 1.);
+    for(i = 0; i < count; i++) values[i] = benchmark->samples[i].tiles;
+    stats[5] = Summarize(values, count, 1.);
+    for(i = 0; i < count; i++) values[i] = benchmark->samples[i].tiletime;
+    stats[6] = Summarize(values, count, 1000.);
+    free(values);
+
+    printf("%s, %d frames\n", description, count);
+    printf("%-16s %12s %12s %12s %12s %12s %12s\n", "",
+           "min", "mean", "p50", "p95", "p99", "max");
+    for(i = 0; i < 7; i++) PrintStatistics(names[i], &stats[i]);
+
+    FILE* f = fopen("benchmark.json", "w");
+    if(f)
+    {
+        fprintf(f, "{\n    \"description\": ");
+        WriteString(f, description);
+        fprintf(f, ",\n    \"frames\": %d,\n", count);
+        for(i = 0; i < 7; i++)
+            WriteStatistics(f, names[i], &stats[i], i == 6);
+        fprintf(f, "}\n");
+        fclose(f);
+    }
+    //Every frame, with the GPU time of each pass, -1 where it didn't run.
+    GpuProfiler* gpu = benchmark->gpu;
+    f = fopen("benchmark.csv", "w");
+    if(f)
+    {
+        int j;
+        fprintf(f, "frame,frametime,cputime,gputime,vertices,invocations,"
+                   "tiles,tiletime");
+        for(j = 0; j < gpu->pass_count; j++)
+            fprintf(f, ",gpu %s", gpu->passes[j].name);
+        fprintf(f, "\n");
+        for(i = 0; i < count; i++)
+        {
+            BenchmarkSample* s = &benchmark->samples[i];
+            fprintf(f, "%d,%.6f,%.6f,%.6f,%.0f,%.0f,%.0f,%.6f", i,
+                    s->frametime*1000.f, s->cputime*1000.f,
+                    s->gputime < 0.f ? -1.f : s->gputime*1000.f,
+                    s->vertices, s->invocations, s->tiles,
+                    s->tiletime < 0.f ? -1.f : s->tiletime*1000.f);
+            for(j = 0; j < gpu->pass_count; j++)
+            {
+                fprintf(f, ",%.6f",
+                        s->passes[j] < 0.f ? -1.f : s->passes[j]*1000.f);
+            }
+            fprintf(f, "\n");
+        }
+        fclose(f);
+    }
+}
+
+void DestroyBenchmark(Benchmark* benchmark)
+{
+    free(benchmark->samples);
+    free(benchmark->keyframes);
+}
@@ -0,0 +1,58 @@
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <glad/glad.h>
+#include <SDL2/SDL.h>
+#include "Camera.h"
+#include "GpuProfiler.h"
+
+#define BENCHMARK_STEP (1.f/60.f) //Seconds of flight per frame
+#define BENCHMARK_WARMUP 60       //Unrecorded frames at the first keyframe
+
+typedef struct
+{
+    float time;
+    vec3 position;
+    float yaw, pitch;
+} Keyframe;
+
+typedef struct
+{
+    float frametime, cputime, gputime;
+    double vertices, invocations;
+    float passes[GPU_PROFILER_PASSES]; //GPU time of each pass
+    double tiles;   //Terrain tiles generated
+    float tiletime; //CPU time generating them
+} BenchmarkSample;
+
+/*
+ * Flies the camera along a Catmull-Rom spline through keyframes loaded from
+ * a file, advancing a fixed step per frame, and records the frame time,
+ * CPU time, GPU time, vertices submitted and vertex shader invocations of
+ * every frame. The GPU numbers come from the GPU profiler a few frames
+ * later, and are negative where unsupported. Where the terrain caches
+ * tiles, the tiles generated and the CPU time that took are recorded too,
+ * to compare the tile generators.
+ */
+typedef struct
+{
+    Keyframe* keyframes;
+    int keyframe_count;
+    int frame, frame_count;
+    BenchmarkSample* samples;
+    Uint64 cpu_start;
+    GpuProfiler* gpu;
+    long gpu_start; //GPU profiler frame of the first recorded frame
+} Benchmark;
+
+int ConstructBenchmark(Benchmark* benchmark, const char* path,
+                       GpuProfiler* gpu);
+int UpdateBenchmark(Benchmark* benchmark, Camera* camera);
+void BeginBenchmarkFrame(Benchmark* benchmark);
+void EndBenchmarkFrame(Benchmark* benchmark);
+void RecordBenchmarkTiles(Benchmark* benchmark, int tiles, float time);
+void FinishBenchmarkFrame(Benchmark* benchmark, float frametime);
+void ReportBenchmark(Benchmark* benchmark, const char* description);
+void DestroyBenchmark(Benchmark* benchmark);
+
+#endif
@@ -1,12 +1,13 @@
 #include "Camera.h"
+#include "Profiler.h"
 
 static vec3 CAMERA_DIRECTION = { 0.f, 0.f, -1.f };
 static vec3 CAMERA_UP = { 0.f, 1.f, 0.f };
 static vec3 CAMERA_RIGHT = { 1.f, 0.f, 0.f };
 
-void ConstructCamera(Camera* camera)
+void ConstructCamera(Camera* camera, Hierarchy* hierarchy)
 {
-    ConstructNode(&camera->node);
+    ConstructNode(&camera->node, hierarchy);
     int i;
     for(i = 0; i < 3; i++)
     {
@@ -17,34 +18,54 @@ void ConstructCamera(Camera* camera)
     camera->yaw = 0.f;
     camera->pitch = 0.f;
     camera->roll = 0.f;
+    camera->last_yaw = 0.f;
+    camera->last_pitch = 0.f;
+    camera->last_roll = 0.f;
     vec3 center;
-    vec3_add(center, camera->node.position, camera->direction);
-    mat4x4_look_at(camera->view_matrix,
-                   camera->node.position,
-                   center,
-                   camera->up);
+    float* position = GetNodePosition(&camera->node);
+    for(i = 0; i < 3; i++)
+        camera->last_translation[i] = GetNodeTranslation(&camera->node)[i];
+    vec3_add(center, position, camera->direction);
+    mat4x4_look_at(camera->view_matrix, position, center, camera->up);
 }
 
+/*
+ * Applies the yaw, pitch and roll to the node and brings the view matrix up
+ * to date. If neither they nor the translation changed since the last call,
+ * the node is left alone, so it isn't marked as changed.
+ */
 void UpdateCamera(Camera* camera)
 {
-    quat tmp1, tmp2, tmp3, tmp4;
+    PROFILE_SCOPE("UpdateCamera");
+    float* translation = GetNodeTranslation(&camera->node);
+    if(camera->yaw == camera->last_yaw &&
+       camera->pitch == camera->last_pitch &&
+       camera->roll == camera->last_roll &&
+       translation[0] == camera->last_translation[0] &&
+       translation[1] == camera->last_translation[1] &&
+       translation[2] == camera->last_translation[2])
+        return;
+    camera->last_yaw = camera->yaw;
+    camera->last_pitch = camera->pitch;
+    camera->last_roll = camera->roll;
+    int i;
+    for(i = 0; i < 3; i++) camera->last_translation[i] = translation[i];
+    quat tmp1, tmp2, tmp3, tmp4, rotation;
     quat_rotate(tmp1, camera->yaw, CAMERA_UP);
     quat_rotate(tmp2, camera->pitch, CAMERA_RIGHT);
     quat_rotate(tmp3, camera->roll, camera->direction);
     quat_mul(tmp4, tmp1, tmp2);
-    quat_mul(camera->node.rotation, tmp4, tmp3);
+    quat_mul(rotation, tmp4, tmp3);
+    SetNodeRotation(&camera->node, rotation);
+    ProfileScope update = BeginProfileScope("UpdateNode");
     UpdateNode(&camera->node);
-    quat_mul_vec3(camera->direction,
-                  camera->node.orientation,
-                  CAMERA_DIRECTION);
-    quat_mul_vec3(camera->up,
-                  camera->node.orientation,
-                  CAMERA_UP);
+    EndProfileScope(&update);
+    float* orientation = GetNodeOrientation(&camera->node);
+    quat_mul_vec3(camera->direction, orientation, CAMERA_DIRECTION);
+    quat_mul_vec3(camera->up, orientation, CAMERA_UP);
     vec3_mul_cross(camera->right, camera->direction, camera->up);
     vec3 center;
-    vec3_add(center, camera->node.position, camera->direction);
-    mat4x4_look_at(camera->view_matrix,
-                   camera->node.position,
-                   center,
-                   camera->up);
+    float* position = GetNodePosition(&camera->node);
+    vec3_add(center, position, camera->direction);
+    mat4x4_look_at(camera->view_matrix, position, center, camera->up);
 }
@@ -11,9 +11,11 @@ typedef struct
     vec3 up;
     vec3 right;
     float yaw, pitch, roll;
+    float last_yaw, last_pitch, last_roll; //As of the last update
+    vec3 last_translation;
 } Camera;
 
-void ConstructCamera(Camera* camera);
+void ConstructCamera(Camera* camera, Hierarchy* hierarchy);
 void UpdateCamera(Camera* camera);
 
 #endif
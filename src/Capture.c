@@ -0,0 +1,447 @@
+#include "Capture.h"
+#include "Profiler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void TimeString(char* dst, size_t size)
+{
+    time_t now = time(NULL);
+    strftime(dst, size, "%Y%m%d-%H%M%S", localtime(&now));
+}
+
+static void WritePPM(FILE* f, CaptureJob* job)
+{
+    fprintf(f, "P6\n%d %d\n255\n", job->width, job->height);
+    unsigned char* row = malloc(job->width*3);
+    int x, y;
+    for(y = job->height - 1; y >= 0; y--)
+    {
+        const unsigned char* src = job->pixels + y*job->width*4;
+        for(x = 0; x < job->width; x++)
+        {
+            row[3*x] = src[4*x];
+            row[3*x+1] = src[4*x+1];
+            row[3*x+2] = src[4*x+2];
+        }
+        fwrite(row, 1, job->width*3, f);
+    }
+    free(row);
+}
+
+static unsigned long Crc32(unsigned long crc, const unsigned char* data,
+                           size_t size)
+{
+    static unsigned long table[256];
+    static char valid = 0;
+    size_t i;
+    if(!valid)
+    {
+        unsigned long n, k;
+        for(n = 0; n < 256; n++)
+        {
+            unsigned long c = n;
+            for(k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        valid = 1;
+    }
+    crc ^= 0xffffffffUL;
+    for(i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffUL;
+}
+
+static void PutBigEndian(unsigned char* dst, unsigned long value)
+{
+    dst[0] = value >> 24;
+    dst[1] = value >> 16;
+    dst[2] = value >> 8;
+    dst[3] = value;
+}
+
+static void WriteChunk(FILE* f, const char* type, const unsigned char* data,
+                       size_t size)
+{
+    unsigned char word[4];
+    PutBigEndian(word, size);
+    fwrite(word, 1, 4, f);
+    fwrite(type, 1, 4, f);
+    fwrite(data, 1, size, f);
+    unsigned long crc = Crc32(0, (const unsigned char*)type, 4);
+    PutBigEndian(word, Crc32(crc, data, size));
+    fwrite(word, 1, 4, f);
+}
+
+/*
+ * Writes an uncompressed PNG, with the image data in stored deflate blocks.
+ * Compressing would take longer than writing the extra bytes.
+ */
+static void WritePNG(FILE* f, CaptureJob* job)
+{
+    static const unsigned char signature[] =
+    {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+    };
+    fwrite(signature, 1, sizeof(signature), f);
+    unsigned char header[13];
+    PutBigEndian(header, job->width);
+    PutBigEndian(header + 4, job->height);
+    header[8] = 8;  //Bits per channel
+    header[9] = 2;  //RGB
+    header[10] = header[11] = header[12] = 0;
+    WriteChunk(f, "IHDR", header, sizeof(header));
+
+    size_t raw_size = (size_t)job->height*(job->width*3 + 1);
+    size_t blocks = raw_size/65535 + 1;
+    unsigned char* data = malloc(2 + raw_size + blocks*5 + 4);
+    size_t front = 0, raw_front = 0;
+    unsigned long a = 1, b = 0;
+    int x = 0, y = job->height - 1;
+    data[front++] = 0x78;
+    data[front++] = 0x01;
+    while(blocks--)
+    {
+        size_t size = raw_size - raw_front < 65535 ? raw_size - raw_front :
+                                                     65535;
+        data[front++] = blocks == 0;
+        data[front++] = size & 0xff;
+        data[front++] = size >> 8;
+        data[front++] = ~size & 0xff;
+        data[front++] = (~size >> 8) & 0xff;
+        size_t i;
+        for(i = 0; i < size; i++, raw_front++)
+        {
+            //Each row starts with a filter byte of 0, followed by RGB.
+            unsigned char value;
+            if(x == 0) value = 0;
+            else value = job->pixels[(y*job->width + (x-1)/3)*4 + (x-1)%3];
+            if(++x == job->width*3 + 1)
+            {
+                x = 0;
+                y--;
+            }
+            data[front++] = value;
+            a = (a + value) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    PutBigEndian(data + front, (b << 16) | a);
+    front += 4;
+    WriteChunk(f, "IDAT", data, front);
+    free(data);
+    WriteChunk(f, "IEND", NULL, 0);
+}
+
+static void WriteScreenshot(Capture* capture, CaptureJob* job,
+                            unsigned int number)
+{
+    PROFILE_SCOPE("WriteScreenshot");
+    char time[32], path[64];
+    TimeString(time, sizeof(time));
+    snprintf(path, sizeof(path), "screenshot-%s-%u.%s", time, number,
+             capture->format == CAPTURE_PNG ? "png" : "ppm");
+    FILE* f = fopen(path, "wb");
+    if(!f) return;
+    if(capture->format == CAPTURE_PNG) WritePNG(f, job);
+    else WritePPM(f, job);
+    fclose(f);
+}
+
+/*
+ * Appends a frame to the recording as 4:4:4 Y'CbCr with BT.601 coefficients
+ * and video range, starting a new file if none is open. Frames of a
+ * different size than the first one are skipped, since Y4M can't change
+ * size.
+ */
+static void WriteVideoFrame(Capture* capture, CaptureJob* job)
+{
+    PROFILE_SCOPE("WriteVideoFrame");
+    if(!capture->video)
+    {
+        char time[32], path[64];
+        TimeString(time, sizeof(time));
+        snprintf(path, sizeof(path), "recording-%s.y4m", time);
+        capture->video = fopen(path, "wb");
+        if(!capture->video) return;
+        capture->video_width = job->width;
+        capture->video_height = job->height;
+        fprintf(capture->video, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n",
+                job->width, job->height, capture->fps);
+    }
+    if(job->width != capture->video_width ||
+       job->height != capture->video_height)
+        return;
+    int n = job->width*job->height;
+    unsigned char* planes = malloc(n*3);
+    int x, y, i = 0;
+    for(y = job->height - 1; y >= 0; y--)
+    {
+        const unsigned char* src = job->pixels + y*job->width*4;
+        for(x = 0; x < job->width; x++, i++)
+        {
+            int r = src[4*x], g = src[4*x+1], b = src[4*x+2];
+            planes[i] = ((66*r + 129*g + 25*b + 128) >> 8) + 16;
+            planes[n+i] = ((-38*r - 74*g + 112*b + 128) >> 8) + 128;
+            planes[2*n+i] = ((112*r - 94*g - 18*b + 128) >> 8) + 128;
+        }
+    }
+    fputs("FRAME\n", capture->video);
+    fwrite(planes, 1, n*3, capture->video);
+    free(planes);
+}
+
+static int WriterThread(void* data)
+{
+    Capture* capture = data;
+    unsigned int screenshots = 0;
+    SetProfileThreadName("Capture");
+    while(1)
+    {
+        SDL_LockMutex(capture->mutex);
+        while(!capture->first && !capture->quit)
+            SDL_CondWait(capture->cond, capture->mutex);
+        CaptureJob* job = capture->first;
+        if(job)
+        {
+            capture->first = job->next;
+            if(!capture->first) capture->last = NULL;
+            capture->queued--;
+        }
+        SDL_UnlockMutex(capture->mutex);
+        if(!job) break;
+
+        if(job->kind == CAPTURE_SCREENSHOT)
+        {
+            WriteScreenshot(capture, job, screenshots++);
+        }
+        else if(job->kind == CAPTURE_RECORDING)
+        {
+            WriteVideoFrame(capture, job);
+        }
+        else if(capture->video)
+        {
+            fclose(capture->video);
+            capture->video = NULL;
+        }
+        free(job->pixels);
+        free(job);
+    }
+    if(capture->video) fclose(capture->video);
+    return 0;
+}
+
+/*
+ * Hands a job to the writer thread. Recorded frames are dropped when the
+ * writer is too far behind, so a slow disk doesn't grow the queue without
+ * bound.
+ */
+static void PushJob(Capture* capture, CaptureKind kind, int width, int height,
+                    unsigned char* pixels)
+{
+    SDL_LockMutex(capture->mutex);
+    if(kind == CAPTURE_RECORDING && capture->queued >= CAPTURE_QUEUE)
+    {
+        SDL_UnlockMutex(capture->mutex);
+        capture->dropped++;
+        free(pixels);
+        return;
+    }
+    CaptureJob* job = malloc(sizeof(CaptureJob));
+    job->kind = kind;
+    job->width = width;
+    job->height = height;
+    job->pixels = pixels;
+    job->next = NULL;
+    if(capture->last) capture->last->next = job;
+    else capture->first = job;
+    capture->last = job;
+    capture->queued++;
+    SDL_CondSignal(capture->cond);
+    SDL_UnlockMutex(capture->mutex);
+}
+
+int ConstructCapture(Capture* capture, CaptureFormat format, int fps)
+{
+    int i;
+    for(i = 0; i < CAPTURE_RING; i++)
+    {
+        glGenBuffers(1, &capture->slots[i].pbo);
+        capture->slots[i].fence = 0;
+        capture->slots[i].busy = 0;
+    }
+    capture->front = 0;
+    capture->format = format;
+    capture->fps = fps;
+    capture->recording = 0;
+    capture->screenshot = 0;
+    capture->dropped = 0;
+    capture->first = capture->last = NULL;
+    capture->queued = 0;
+    capture->quit = 0;
+    capture->video = NULL;
+    capture->mutex = SDL_CreateMutex();
+    capture->cond = SDL_CreateCond();
+    capture->thread = SDL_CreateThread(WriterThread, "Capture", capture);
+    if(!capture->thread)
+    {
+        SDL_DestroyCond(capture->cond);
+        SDL_DestroyMutex(capture->mutex);
+        for(i = 0; i < CAPTURE_RING; i++)
+            glDeleteBuffers(1, &capture->slots[i].pbo);
+        return -1;
+    }
+    return 0;
+}
+
+//Captures the next frame as a screenshot.
+void RequestScreenshot(Capture* capture)
+{
+    capture->screenshot = 1;
+}
+
+/*
+ * Maps a slot's pixel buffer and queues a copy of it. If wait is 0 and the
+ * read hasn't finished, returns 0 and leaves the slot as it is.
+ */
+static int RetireSlot(Capture* capture, int i, char wait)
+{
+    if(capture->slots[i].fence)
+    {
+        GLenum status = glClientWaitSync(capture->slots[i].fence,
+                                         GL_SYNC_FLUSH_COMMANDS_BIT,
+                                         wait ? GL_TIMEOUT_IGNORED : 0);
+        if(status == GL_TIMEOUT_EXPIRED) return 0;
+        glDeleteSync(capture->slots[i].fence);
+        capture->slots[i].fence = 0;
+    }
+    else if(!wait && capture->slots[i].age < CAPTURE_RING - 1)
+    {
+        //Without fences, give the read a few frames before mapping.
+        return 0;
+    }
+    int width = capture->slots[i].width, height = capture->slots[i].height;
+    size_t size = (size_t)width*height*4;
+    unsigned char* pixels = malloc(size);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->slots[i].pbo);
+    void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size,
+                                    GL_MAP_READ_BIT);
+    if(mapped)
+    {
+        memcpy(pixels, mapped, size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    capture->slots[i].busy = 0;
+    if(!mapped)
+    {
+        free(pixels);
+        return 1;
+    }
+    if(capture->slots[i].screenshot && capture->slots[i].record)
+    {
+        unsigned char* copy = malloc(size);
+        memcpy(copy, pixels, size);
+        PushJob(capture, CAPTURE_SCREENSHOT, width, height, copy);
+    }
+    PushJob(capture, capture->slots[i].record ? CAPTURE_RECORDING :
+                                                CAPTURE_SCREENSHOT,
+            width, height, pixels);
+    return 1;
+}
+
+//Retires the busy slots from the oldest, stopping at the first unfinished.
+static void RetireSlots(Capture* capture, char wait)
+{
+    int i;
+    for(i = 0; i < CAPTURE_RING; i++)
+    {
+        int slot = (capture->front + i) % CAPTURE_RING;
+        if(!capture->slots[slot].busy) continue;
+        if(!RetireSlot(capture, slot, wait)) break;
+    }
+}
+
+/*
+ * Starts or stops recording. Stopping waits for the frames still being read
+ * so the recording ends with them.
+ */
+void ToggleRecording(Capture* capture)
+{
+    capture->recording = !capture->recording;
+    if(capture->recording) return;
+    RetireSlots(capture, 1);
+    PushJob(capture, CAPTURE_END_RECORDING, 0, 0, NULL);
+}
+
+/*
+ * Starts reading the frame in the current read framebuffer if a screenshot
+ * was requested or a recording is running. Call before swapping buffers.
+ */
+void CaptureFrame(Capture* capture, int width, int height)
+{
+    if(!capture->screenshot && !capture->recording) return;
+    int i = capture->front;
+    if(capture->slots[i].busy)
+    {
+        //The ring is full, which only happens when frames are read faster
+        //than they finish.
+        RetireSlots(capture, 1);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->slots[i].pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width*height*4, NULL,
+                 GL_STREAM_READ);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    capture->slots[i].fence = GLAD_GL_VERSION_3_2 ?
+                              glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) :
+                              0;
+    capture->slots[i].screenshot = capture->screenshot;
+    capture->slots[i].record = capture->recording;
+    capture->slots[i].width = width;
+    capture->slots[i].height = height;
+    capture->slots[i].age = 0;
+    capture->slots[i].busy = 1;
+    capture->screenshot = 0;
+    capture->front = (i + 1) % CAPTURE_RING;
+}
+
+//Hands finished reads to the writer thread. Call once per frame.
+void UpdateCapture(Capture* capture)
+{
+    int i;
+    for(i = 0; i < CAPTURE_RING; i++)
+        if(capture->slots[i].busy) capture->slots[i].age++;
+    RetireSlots(capture, 0);
+}
+
+/*
+ * Returns 1 while frames are being read or a capture is requested, so the
+ * main loop keeps drawing until they are handed off.
+ */
+int CapturePending(Capture* capture)
+{
+    int i;
+    if(capture->screenshot || capture->recording) return 1;
+    for(i = 0; i < CAPTURE_RING; i++)
+        if(capture->slots[i].busy) return 1;
+    return 0;
+}
+
+//Writes everything captured so far and stops the writer thread.
+void DestroyCapture(Capture* capture)
+{
+    if(capture->recording) ToggleRecording(capture);
+    RetireSlots(capture, 1);
+    SDL_LockMutex(capture->mutex);
+    capture->quit = 1;
+    SDL_CondSignal(capture->cond);
+    SDL_UnlockMutex(capture->mutex);
+    SDL_WaitThread(capture->thread, NULL);
+    SDL_DestroyCond(capture->cond);
+    SDL_DestroyMutex(capture->mutex);
+    int i;
+    for(i = 0; i < CAPTURE_RING; i++)
+        glDeleteBuffers(1, &capture->slots[i].pbo);
+}
@@ -0,0 +1,79 @@
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <SDL2/SDL.h>
+#include <glad/glad.h>
+#include <stdio.h>
+
+#define CAPTURE_RING 3      //Frames between reading a frame and mapping it
+#define CAPTURE_QUEUE 16    //Frames waiting to be written before dropping
+
+typedef enum
+{
+    CAPTURE_PPM,
+    CAPTURE_PNG
+} CaptureFormat;
+
+typedef enum
+{
+    CAPTURE_SCREENSHOT,
+    CAPTURE_RECORDING,
+    CAPTURE_END_RECORDING
+} CaptureKind;
+
+/*
+ * A frame read back from the GPU, waiting for the writer thread. Rows are
+ * bottom to top, as read.
+ */
+typedef struct CaptureJob
+{
+    CaptureKind kind;
+    int width, height;
+    unsigned char* pixels;
+    struct CaptureJob* next;
+} CaptureJob;
+
+/*
+ * Screenshots and recordings read with glReadPixels into a ring of pixel
+ * buffers, so the read does not stall the frame. A buffer is mapped when its
+ * fence has passed, and the copy is encoded and written on a background
+ * thread. Recordings are written as Y4M, with fps frames per second in the
+ * header.
+ */
+typedef struct
+{
+    struct
+    {
+        GLuint pbo;
+        GLsync fence;
+        char screenshot, record;
+        int width, height;
+        int age;
+        char busy;
+    } slots[CAPTURE_RING];
+    int front;
+    CaptureFormat format;
+    int fps;
+    char recording;
+    char screenshot;
+    int dropped;
+    SDL_Thread* thread;
+    SDL_mutex* mutex;
+    SDL_cond* cond;
+    CaptureJob* first;
+    CaptureJob* last;
+    int queued;
+    char quit;
+    FILE* video;
+    int video_width, video_height;
+} Capture;
+
+int ConstructCapture(Capture* capture, CaptureFormat format, int fps);
+void RequestScreenshot(Capture* capture);
+void ToggleRecording(Capture* capture);
+void CaptureFrame(Capture* capture, int width, int height);
+void UpdateCapture(Capture* capture);
+int CapturePending(Capture* capture);
+void DestroyCapture(Capture* capture);
+
+#endif
@@ -0,0 +1,43 @@
+#include "Frustum.h"
+
+/*
+ * Gets the clip planes from a combined projection and view matrix. Plane
+ * normals point inwards and are normalized, so plane distances are in world
+ * units.
+ */
+void ExtractFrustum(Frustum* frustum, mat4x4 m)
+{
+    int i, j;
+    for(i = 0; i < 3; i++)
+    {
+        for(j = 0; j < 4; j++)
+        {
+            frustum->planes[2*i][j] = m[j][3] + m[j][i];
+            frustum->planes[2*i+1][j] = m[j][3] - m[j][i];
+        }
+    }
+    for(i = 0; i < 6; i++)
+    {
+        float* p = frustum->planes[i];
+        float len = sqrtf(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+        for(j = 0; j < 4; j++) p[j] /= len;
+    }
+}
+
+/*
+ * Conservative test of an axis aligned box. Returns 0 only if the box is
+ * entirely outside one of the planes.
+ */
+int BoxInFrustum(Frustum* frustum, vec3 min, vec3 max)
+{
+    int i;
+    for(i = 0; i < 6; i++)
+    {
+        float* p = frustum->planes[i];
+        float x = p[0] > 0.f ? max[0] : min[0];
+        float y = p[1] > 0.f ? max[1] : min[1];
+        float z = p[2] > 0.f ? max[2] : min[2];
+        if(p[0]*x + p[1]*y + p[2]*z + p[3] < 0.f) return 0;
+    }
+    return 1;
+}
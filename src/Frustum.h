@@ -0,0 +1,14 @@
+#ifndef FRUSTUM_H_
+#define FRUSTUM_H_
+
+#include <linmath.h>
+
+typedef struct
+{
+    vec4 planes[6];
+} Frustum;
+
+void ExtractFrustum(Frustum* frustum, mat4x4 view_projection);
+int BoxInFrustum(Frustum* frustum, vec3 min, vec3 max);
+
+#endif
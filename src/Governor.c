@@ -0,0 +1,90 @@
+#include "Governor.h"
+#include <stdlib.h>
+#include <math.h>
+
+#define GOVERNOR_PERCENTILE 0.9f
+#define GOVERNOR_HIGH 1.15f     //Lower view distance above budget*HIGH
+#define GOVERNOR_LOW 0.85f      //Raise view distance below budget*LOW
+#define GOVERNOR_DECREASE 0.85f
+#define GOVERNOR_INCREASE 1.1f
+#define GOVERNOR_HOLD 8         //Windows to stay below a failed distance
+
+void ConstructGovernor(Governor* governor, Settings* settings)
+{
+    governor->budget = settings->graphics.frametimebudget / 1000.f;
+    governor->minviewdistance = settings->graphics.minviewdistance;
+    governor->maxviewdistance = settings->graphics.maxviewdistance;
+    governor->viewdistance = settings->graphics.viewdistance;
+    if(governor->viewdistance < governor->minviewdistance)
+        governor->viewdistance = governor->minviewdistance;
+    else if(governor->viewdistance > governor->maxviewdistance)
+        governor->viewdistance = governor->maxviewdistance;
+    governor->ceiling = governor->maxviewdistance;
+    governor->ceiling_hold = 0;
+    ResetGovernor(governor);
+}
+
+/*
+ * Discards the collected samples, e.g. after a change that makes them
+ * unrepresentative.
+ */
+void ResetGovernor(Governor* governor)
+{
+    governor->front = 0;
+    governor->count = 0;
+}
+
+static int CompareFloat(const void* a, const void* b)
+{
+    float fa = *(const float*)a, fb = *(const float*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+static float Percentile(Governor* governor, float p)
+{
+    float sorted[GOVERNOR_WINDOW];
+    int i;
+    for(i = 0; i < governor->count; i++) sorted[i] = governor->samples[i];
+    qsort(sorted, governor->count, sizeof(float), CompareFloat);
+    return sorted[(int)(p * (governor->count - 1))];
+}
+
+/*
+ * Records the duration of the last frame in seconds. Decisions are only made
+ * once a full window of samples has been collected at the current view
+ * distance, and a distance that exceeded the budget is not retried until it
+ * has been held below for a while. Returns 1 if the view distance changed.
+ */
+int UpdateGovernor(Governor* governor, float frametime)
+{
+    governor->samples[governor->front] = frametime;
+    governor->front = (governor->front + 1) % GOVERNOR_WINDOW;
+    if(governor->count < GOVERNOR_WINDOW) governor->count++;
+    if(governor->count < GOVERNOR_WINDOW) return 0;
+
+    float p = Percentile(governor, GOVERNOR_PERCENTILE);
+    float vd = governor->viewdistance;
+    if(p > governor->budget * GOVERNOR_HIGH)
+    {
+        governor->ceiling = vd;
+        governor->ceiling_hold = GOVERNOR_HOLD;
+        vd *= GOVERNOR_DECREASE;
+    }
+    else if(p < governor->budget * GOVERNOR_LOW)
+    {
+        if(governor->ceiling_hold > 0 && --governor->ceiling_hold == 0)
+            governor->ceiling = governor->maxviewdistance;
+        vd *= GOVERNOR_INCREASE;
+        if(vd >= governor->ceiling)
+            vd = governor->ceiling * GOVERNOR_DECREASE;
+        if(vd < governor->viewdistance) vd = governor->viewdistance;
+    }
+
+    vd = floor(vd);
+    if(vd < governor->minviewdistance) vd = governor->minviewdistance;
+    else if(vd > governor->maxviewdistance) vd = governor->maxviewdistance;
+    ResetGovernor(governor);
+    if(vd == governor->viewdistance) return 0;
+    governor->viewdistance = vd;
+    return 1;
+}
@@ -0,0 +1,27 @@
+#ifndef GOVERNOR_H_
+#define GOVERNOR_H_
+
+#include "Settings.h"
+
+#define GOVERNOR_WINDOW 120
+
+/*
+ * Adjusts the view distance at runtime to keep a percentile of the recent
+ * frame times within the frame time budget.
+ */
+typedef struct
+{
+    float samples[GOVERNOR_WINDOW];
+    int front, count;
+    float budget;
+    float viewdistance;
+    float minviewdistance, maxviewdistance;
+    float ceiling;
+    int ceiling_hold;
+} Governor;
+
+void ConstructGovernor(Governor* governor, Settings* settings);
+int UpdateGovernor(Governor* governor, float frametime);
+void ResetGovernor(Governor* governor);
+
+#endif
@@ -0,0 +1,178 @@
+#include "GpuProfiler.h"
+#include "Profiler.h"
+#include <stdio.h>
+
+void ConstructGpuProfiler(GpuProfiler* profiler)
+{
+    profiler->pass_count = 0;
+    profiler->current = -1;
+    profiler->frame = 0;
+    profiler->last_frame = -1;
+    profiler->timer = GLAD_GL_VERSION_3_3;
+    profiler->statistics = GLAD_GL_ARB_pipeline_statistics_query ||
+                           GLAD_GL_VERSION_4_6;
+    int i, j;
+    for(i = 0; i < GPU_PROFILER_LATENCY; i++)
+    {
+        GpuFrame* frame = &profiler->frames[i];
+        for(j = 0; j < GPU_PROFILER_PASSES; j++)
+        {
+            GpuPassFrame* p = &frame->passes[j];
+            if(profiler->timer) glGenQueries(1, &p->time_query);
+            if(profiler->statistics)
+            {
+                glGenQueries(1, &p->vertices_query);
+                glGenQueries(1, &p->invocations_query);
+                glGenQueries(1, &p->primitives_query);
+            }
+            p->used = 0;
+        }
+        frame->frame = -1;
+        frame->ready = 0;
+    }
+}
+
+static GLuint64 GetResult(GLuint query)
+{
+    GLuint64 result;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &result);
+    return result;
+}
+
+/*
+ * Reads the queries of the frame that last used a slot, waiting if needed,
+ * and records the GPU times to the CPU trace.
+ */
+static void ReadFrame(GpuProfiler* profiler, int slot)
+{
+    GpuFrame* frame = &profiler->frames[slot];
+    if(frame->frame < 0 || frame->ready) return;
+    frame->time = profiler->timer ? 0. : -1.;
+    frame->vertices = frame->invocations = frame->primitives =
+        profiler->statistics ? 0. : -1.;
+    int i;
+    for(i = 0; i < GPU_PROFILER_PASSES; i++)
+    {
+        GpuPassFrame* p = &frame->passes[i];
+        p->time = p->vertices = p->invocations = p->primitives = -1.;
+        if(!p->used) continue;
+        if(profiler->timer)
+        {
+            p->time = GetResult(p->time_query) / 1e9;
+            frame->time += p->time;
+            ProfileCounter(profiler->passes[i].label, p->time * 1000.);
+        }
+        if(profiler->statistics)
+        {
+            p->vertices = GetResult(p->vertices_query);
+            p->invocations = GetResult(p->invocations_query);
+            p->primitives = GetResult(p->primitives_query);
+            frame->vertices += p->vertices;
+            frame->invocations += p->invocations;
+            frame->primitives += p->primitives;
+        }
+        p->used = 0;
+    }
+    if(profiler->statistics)
+        ProfileCounter("GPU vertex invocations", frame->invocations);
+    frame->ready = 1;
+    if(frame->frame > profiler->last_frame)
+        profiler->last_frame = frame->frame;
+}
+
+/*
+ * Starts recording a frame in the slot of the oldest frame, which was read
+ * when the frame before began, then reads the next oldest. Results stay
+ * available until their slot is reused.
+ */
+void BeginGpuFrame(GpuProfiler* profiler)
+{
+    int slot = profiler->frame % GPU_PROFILER_LATENCY;
+    ReadFrame(profiler, slot);
+    profiler->frames[slot].frame = profiler->frame;
+    profiler->frames[slot].ready = 0;
+    ReadFrame(profiler, (slot + 1) % GPU_PROFILER_LATENCY);
+}
+
+//Starts measuring the GL work of a pass, registering it the first time.
+void BeginGpuPass(GpuProfiler* profiler, const char* name)
+{
+    int i;
+    for(i = 0; i < profiler->pass_count; i++)
+        if(profiler->passes[i].name == name) break;
+    if(i == profiler->pass_count)
+    {
+        if(i == GPU_PROFILER_PASSES) return;
+        GpuPass* pass = &profiler->passes[i];
+        pass->name = name;
+        snprintf(pass->label, sizeof(pass->label), "GPU %s ms", name);
+        profiler->pass_count++;
+    }
+    GpuPassFrame* p = &profiler->frames[profiler->frame %
+                                        GPU_PROFILER_LATENCY].passes[i];
+    if(profiler->timer) glBeginQuery(GL_TIME_ELAPSED, p->time_query);
+    if(profiler->statistics)
+    {
+        glBeginQuery(GL_VERTICES_SUBMITTED_ARB, p->vertices_query);
+        glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB, p->invocations_query);
+        glBeginQuery(GL_PRIMITIVES_SUBMITTED_ARB, p->primitives_query);
+    }
+    p->used = 1;
+    profiler->current = i;
+}
+
+void EndGpuPass(GpuProfiler* profiler)
+{
+    if(profiler->current < 0) return;
+    if(profiler->timer) glEndQuery(GL_TIME_ELAPSED);
+    if(profiler->statistics)
+    {
+        glEndQuery(GL_VERTICES_SUBMITTED_ARB);
+        glEndQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB);
+        glEndQuery(GL_PRIMITIVES_SUBMITTED_ARB);
+    }
+    profiler->current = -1;
+}
+
+void EndGpuFrame(GpuProfiler* profiler)
+{
+    profiler->frame++;
+}
+
+//Gets the results of a frame, or NULL if they aren't read or are overwritten.
+const GpuFrame* GetGpuFrame(GpuProfiler* profiler, long frame)
+{
+    if(frame < 0) return NULL;
+    GpuFrame* f = &profiler->frames[frame % GPU_PROFILER_LATENCY];
+    return f->frame == frame && f->ready ? f : NULL;
+}
+
+//Reads every frame still waiting, e.g. before reporting at exit.
+void FlushGpuProfiler(GpuProfiler* profiler)
+{
+    long frame;
+    for(frame = profiler->frame - GPU_PROFILER_LATENCY;
+        frame < profiler->frame; frame++)
+    {
+        if(frame >= 0) ReadFrame(profiler, frame % GPU_PROFILER_LATENCY);
+    }
+}
+
+void DestroyGpuProfiler(GpuProfiler* profiler)
+{
+    int i, j;
+    for(i = 0; i < GPU_PROFILER_LATENCY; i++)
+    {
+        for(j = 0; j < GPU_PROFILER_PASSES; j++)
+        {
+            GpuPassFrame* p = &profiler->frames[i].passes[j];
+            if(profiler->timer) glDeleteQueries(1, &p->time_query);
+            if(profiler->statistics)
+            {
+                glDeleteQueries(1, &p->vertices_query);
+                glDeleteQueries(1, &p->invocations_query);
+                glDeleteQueries(1, &p->primitives_query);
+            }
+        }
+    }
+}
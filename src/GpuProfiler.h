@@ -0,0 +1,58 @@
+#ifndef GPUPROFILER_H_
+#define GPUPROFILER_H_
+
+#include <glad/glad.h>
+
+#define GPU_PROFILER_LATENCY 4 //Frames in the ring, read one frame early
+#define GPU_PROFILER_PASSES 8  //Most passes measured per frame
+
+typedef struct
+{
+    const char* name;
+    char label[32]; //Name of the pass' counter in the CPU trace
+} GpuPass;
+
+typedef struct
+{
+    GLuint time_query, vertices_query, invocations_query, primitives_query;
+    char used;
+    //Results once read, negative where unsupported or where the pass didn't
+    //run that frame. Time is in seconds.
+    double time, vertices, invocations, primitives;
+} GpuPassFrame;
+
+typedef struct
+{
+    GpuPassFrame passes[GPU_PROFILER_PASSES];
+    long frame; //-1 when there is nothing to read
+    char ready;
+    //Sums over the frame's passes, once read.
+    double time, vertices, invocations, primitives;
+} GpuFrame;
+
+/*
+ * Measures the GPU time, vertices and primitives submitted and vertex shader
+ * invocations of each render pass with queries, kept in a ring of frames so
+ * they are read back a few frames later without stalling. Passes can't be
+ * nested. Time needs GL 3.3, and the counts ARB_pipeline_statistics_query.
+ */
+typedef struct
+{
+    GpuPass passes[GPU_PROFILER_PASSES];
+    int pass_count, current;
+    GpuFrame frames[GPU_PROFILER_LATENCY];
+    long frame;      //Frame being recorded
+    long last_frame; //Latest frame read, -1 before the first
+    char timer, statistics;
+} GpuProfiler;
+
+void ConstructGpuProfiler(GpuProfiler* profiler);
+void BeginGpuFrame(GpuProfiler* profiler);
+void BeginGpuPass(GpuProfiler* profiler, const char* name);
+void EndGpuPass(GpuProfiler* profiler);
+void EndGpuFrame(GpuProfiler* profiler);
+const GpuFrame* GetGpuFrame(GpuProfiler* profiler, long frame);
+void FlushGpuProfiler(GpuProfiler* profiler);
+void DestroyGpuProfiler(GpuProfiler* profiler);
+
+#endif
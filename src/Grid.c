@@ -0,0 +1,40 @@
+#include "Grid.h"
+
+//Indices of a triangle strip over an n by n grid.
+int GridIndexCount(int n)
+{
+    return 2*(n-1) + 2*(n-1)*n;
+}
+
+//Writes the n by n grid points, step units apart.
+void FillGridVertices(float* vs, int n, int step)
+{
+    int i, j, front = 0;
+    for(i = 0; i < n; i++)
+    {
+        for(j = 0; j < n; j++)
+        {
+            vs[front++] = i*step;
+            vs[front++] = j*step;
+        }
+    }
+}
+
+/*
+ * Writes a triangle strip over an n by n grid, with degenerate triangles
+ * joining the rows.
+ */
+void FillGridIndices(unsigned int* is, int n)
+{
+    int i, j, front = 0;
+    for(i = 0; i < n-1; i++)
+    {
+        is[front++] = i*n;
+        for(j = 0; j < n; j++)
+        {
+            is[front++] = i*n+j;
+            is[front++] = (i+1)*n+j;
+        }
+        is[front++] = (i+1)*n+n-1;
+    }
+}
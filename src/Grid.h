@@ -0,0 +1,12 @@
+#ifndef GRID_H_
+#define GRID_H_
+
+/*
+ * Contents of the grid buffers the terrain tiles are drawn with, kept apart
+ * from the GL buffer creation so they can be used without a context.
+ */
+int GridIndexCount(int n);
+void FillGridVertices(float* vs, int n, int step);
+void FillGridIndices(unsigned int* is, int n);
+
+#endif
@@ -0,0 +1,188 @@
+#include "Headless.h"
+#include "Startup.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <string.h>
+
+/*
+ * Gets a display that needs no window system, preferring the surfaceless
+ * platform where Mesa has it.
+ */
+static EGLDisplay GetDisplay()
+{
+    const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if(extensions && strstr(extensions, "EGL_MESA_platform_surfaceless"))
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+            eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if(getPlatformDisplay)
+        {
+            EGLDisplay display =
+                getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                   EGL_DEFAULT_DISPLAY, NULL);
+            if(display != EGL_NO_DISPLAY) return display;
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+/*
+ * Creates a 4.3 core context like the windowed path, or 3.1 if unavailable,
+ * sharing objects with share unless it is EGL_NO_CONTEXT.
+ */
+static EGLContext CreateContext(EGLDisplay display, EGLContext share)
+{
+    //There are no window surfaces, which configs default to.
+    static const EGLint config_attributes[] =
+    {
+        EGL_SURFACE_TYPE, 0,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint count = 0;
+    if(!eglChooseConfig(display, config_attributes, &config, 1, &count) ||
+       count == 0)
+        return EGL_NO_CONTEXT;
+    EGLint attributes[] =
+    {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, share,
+                                          attributes);
+    if(context == EGL_NO_CONTEXT)
+    {
+        attributes[1] = 3;
+        attributes[3] = 1;
+        attributes[4] = EGL_NONE;
+        context = eglCreateContext(display, config, share, attributes);
+    }
+    return context;
+}
+
+/*
+ * Creates the context and the framebuffer the frames are drawn into, and
+ * loads the GL functions. Returns a negative value on failure.
+ */
+int ConstructHeadless(Headless* headless, int width, int height)
+{
+    EGLDisplay display = GetDisplay();
+    if(display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+        return -1;
+    if(!eglBindAPI(EGL_OPENGL_API))
+    {
+        eglTerminate(display);
+        return -2;
+    }
+    EGLContext context = CreateContext(display, EGL_NO_CONTEXT);
+    if(context == EGL_NO_CONTEXT ||
+       !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        if(context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+        eglTerminate(display);
+        return -3;
+    }
+    headless->display = display;
+    headless->context = context;
+    headless->fbo = headless->color = headless->depth = 0;
+    headless->fences[0] = headless->fences[1] = 0;
+    headless->front = 0;
+    int phase = BeginStartupPhase("gladLoadGLLoader");
+    if(!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+    {
+        DestroyHeadless(headless);
+        return -4;
+    }
+    EndStartupPhase(phase);
+
+    headless->width = width;
+    headless->height = height;
+    glGenRenderbuffers(1, &headless->color);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless->color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &headless->depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless->depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width,
+                          height);
+    glGenFramebuffers(1, &headless->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, headless->fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, headless->color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, headless->depth);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        DestroyHeadless(headless);
+        return -5;
+    }
+    return 0;
+}
+
+/*
+ * Stands in for swapping buffers. Waits until the frame before the last one
+ * has finished, so the CPU runs at most two frames ahead as with a swap
+ * chain, instead of queueing work without limit.
+ */
+void FinishHeadlessFrame(Headless* headless)
+{
+    if(!GLAD_GL_VERSION_3_2)
+    {
+        glFinish();
+        return;
+    }
+    GLsync* fence = &headless->fences[headless->front];
+    if(*fence)
+    {
+        glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                         GL_TIMEOUT_IGNORED);
+        glDeleteSync(*fence);
+    }
+    *fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    headless->front = !headless->front;
+}
+
+/*
+ * Creates a context sharing objects with the offscreen one, for another
+ * thread to make current with MakeHeadlessWorkerCurrent. Returns NULL on
+ * failure.
+ */
+void* CreateHeadlessWorker(Headless* headless)
+{
+    EGLContext context = CreateContext(headless->display, headless->context);
+    return context == EGL_NO_CONTEXT ? NULL : context;
+}
+
+//Makes a worker context current on the calling thread, or none if NULL.
+int MakeHeadlessWorkerCurrent(Headless* headless, void* worker)
+{
+    EGLContext context = worker ? worker : EGL_NO_CONTEXT;
+    return eglMakeCurrent(headless->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                          context) ? 0 : -1;
+}
+
+void DestroyHeadlessWorker(Headless* headless, void* worker)
+{
+    eglDestroyContext(headless->display, worker);
+}
+
+void DestroyHeadless(Headless* headless)
+{
+    if(glDeleteFramebuffers)
+    {
+        int i;
+        for(i = 0; i < 2; i++)
+            if(headless->fences[i]) glDeleteSync(headless->fences[i]);
+        glDeleteFramebuffers(1, &headless->fbo);
+        glDeleteRenderbuffers(1, &headless->color);
+        glDeleteRenderbuffers(1, &headless->depth);
+    }
+    eglMakeCurrent(headless->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                   EGL_NO_CONTEXT);
+    eglDestroyContext(headless->display, headless->context);
+    eglTerminate(headless->display);
+}
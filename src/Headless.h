@@ -0,0 +1,29 @@
+#ifndef HEADLESS_H_
+#define HEADLESS_H_
+
+#include <glad/glad.h>
+
+/*
+ * Offscreen GL context for running without a display. The context is made
+ * current without a surface through EGL, and frames are drawn into a
+ * framebuffer object of the configured size that stays bound in place of
+ * the default framebuffer.
+ */
+typedef struct
+{
+    void* display;
+    void* context;
+    GLuint fbo, color, depth;
+    int width, height;
+    GLsync fences[2];
+    int front;
+} Headless;
+
+int ConstructHeadless(Headless* headless, int width, int height);
+void FinishHeadlessFrame(Headless* headless);
+void* CreateHeadlessWorker(Headless* headless);
+int MakeHeadlessWorkerCurrent(Headless* headless, void* worker);
+void DestroyHeadlessWorker(Headless* headless, void* worker);
+void DestroyHeadless(Headless* headless);
+
+#endif
@@ -0,0 +1,278 @@
+#include "Hierarchy.h"
+#include <stdlib.h>
+#include <string.h>
+
+void ConstructHierarchy(Hierarchy* hierarchy)
+{
+    hierarchy->count = 0;
+    hierarchy->capacity = 0;
+    hierarchy->parents = NULL;
+    hierarchy->rotations = NULL;
+    hierarchy->translations = NULL;
+    hierarchy->world_matrices = NULL;
+    hierarchy->orientations = NULL;
+    hierarchy->positions = NULL;
+    hierarchy->ids = NULL;
+    hierarchy->indices = NULL;
+    hierarchy->ends = NULL;
+    hierarchy->changed = NULL;
+    hierarchy->passes = NULL;
+    hierarchy->pass = 0;
+    hierarchy->dirty = NULL;
+    hierarchy->dirty_count = 0;
+    hierarchy->marks = NULL;
+}
+
+static void Grow(Hierarchy* h)
+{
+    h->capacity = h->capacity ? h->capacity*2 : 64;
+    h->parents = realloc(h->parents, h->capacity*sizeof(int));
+    h->rotations = realloc(h->rotations, h->capacity*sizeof(quat));
+    h->translations = realloc(h->translations, h->capacity*sizeof(vec3));
+    h->world_matrices = realloc(h->world_matrices,
+                                h->capacity*sizeof(mat4x4));
+    h->orientations = realloc(h->orientations, h->capacity*sizeof(quat));
+    h->positions = realloc(h->positions, h->capacity*sizeof(vec3));
+    h->ids = realloc(h->ids, h->capacity*sizeof(int));
+    h->indices = realloc(h->indices, h->capacity*sizeof(int));
+    h->ends = realloc(h->ends, h->capacity*sizeof(int));
+    h->changed = realloc(h->changed, h->capacity);
+    h->passes = realloc(h->passes, h->capacity*sizeof(unsigned int));
+    h->dirty = realloc(h->dirty, h->capacity*sizeof(int));
+    h->marks = realloc(h->marks, h->capacity);
+}
+
+//Adds a root node with no rotation or translation. Returns its id.
+int AddHierarchyNode(Hierarchy* hierarchy)
+{
+    Hierarchy* h = hierarchy;
+    if(h->count == h->capacity) Grow(h);
+    int i = h->count++;
+    h->parents[i] = -1;
+    quat_identity(h->rotations[i]);
+    mat4x4_identity(h->world_matrices[i]);
+    quat_identity(h->orientations[i]);
+    int j;
+    for(j = 0; j < 3; j++)
+    {
+        h->translations[i][j] = 0.f;
+        h->positions[i][j] = 0.f;
+    }
+    h->ids[i] = i;
+    h->indices[i] = i;
+    h->ends[i] = i;
+    h->changed[i] = 0;
+    h->passes[i] = h->pass;
+    return i;
+}
+
+//Notes that the local transform of the node at index i changed.
+static void MarkChanged(Hierarchy* h, int i)
+{
+    if(h->changed[i]) return;
+    h->changed[i] = 1;
+    h->dirty[h->dirty_count++] = i;
+}
+
+/*
+ * Marks the nodes from index i on that are in the subtree of the node at i.
+ * Parents come first, so one pass finds them all.
+ */
+static void MarkSubtree(Hierarchy* h, int i)
+{
+    int j;
+    h->marks[i] = 1;
+    for(j = i + 1; j < h->count; j++)
+    {
+        int p = h->parents[j];
+        h->marks[j] = p >= i && h->marks[p];
+    }
+}
+
+//Puts the element at order[k] of an array at k.
+static void Reorder(void* array, size_t size, const int* order, int count,
+                    char* scratch)
+{
+    char* a = array;
+    int k;
+    for(k = 0; k < count; k++)
+        memcpy(scratch + k*size, a + order[k]*size, size);
+    memcpy(a, scratch, count*size);
+}
+
+/*
+ * Moves the subtree of the node at index i after all other nodes, keeping
+ * the order within and outside of it.
+ */
+static void MoveSubtreeToEnd(Hierarchy* h, int i)
+{
+    int* order = malloc(h->count*sizeof(int));
+    int* remap = malloc(h->count*sizeof(int));
+    char* scratch = malloc(h->count*sizeof(mat4x4));
+    int j, k = 0;
+    MarkSubtree(h, i);
+    for(j = 0; j < h->count; j++)
+        if(j < i || !h->marks[j]) order[k++] = j;
+    for(j = i; j < h->count; j++)
+        if(h->marks[j]) order[k++] = j;
+    for(k = 0; k < h->count; k++) remap[order[k]] = k;
+
+    Reorder(h->rotations, sizeof(quat), order, h->count, scratch);
+    Reorder(h->translations, sizeof(vec3), order, h->count, scratch);
+    Reorder(h->world_matrices, sizeof(mat4x4), order, h->count, scratch);
+    Reorder(h->orientations, sizeof(quat), order, h->count, scratch);
+    Reorder(h->positions, sizeof(vec3), order, h->count, scratch);
+    Reorder(h->ids, sizeof(int), order, h->count, scratch);
+    Reorder(h->parents, sizeof(int), order, h->count, scratch);
+    Reorder(h->changed, 1, order, h->count, scratch);
+    Reorder(h->passes, sizeof(unsigned int), order, h->count, scratch);
+    for(k = 0; k < h->count; k++)
+    {
+        h->indices[h->ids[k]] = k;
+        if(h->parents[k] >= 0) h->parents[k] = remap[h->parents[k]];
+    }
+    for(k = 0; k < h->dirty_count; k++) h->dirty[k] = remap[h->dirty[k]];
+
+    //Descendants come after their ancestors, so one pass back to front
+    //finds where each subtree ends.
+    for(k = 0; k < h->count; k++) h->ends[k] = k;
+    for(k = h->count - 1; k >= 0; k--)
+    {
+        int p = h->parents[k];
+        if(p >= 0 && h->ends[k] > h->ends[p]) h->ends[p] = h->ends[k];
+    }
+    free(scratch);
+    free(remap);
+    free(order);
+}
+
+/*
+ * Makes a node a child of another, or a root if parent is -1. Fails if the
+ * parent is in the subtree of the node.
+ */
+int SetHierarchyParent(Hierarchy* hierarchy, int node, int parent)
+{
+    Hierarchy* h = hierarchy;
+    int i = h->indices[node];
+    if(parent < 0)
+    {
+        //The ends of the old ancestors may now be too far, which is safe.
+        h->parents[i] = -1;
+        MarkChanged(h, i);
+        return 0;
+    }
+    int p;
+    for(p = h->indices[parent]; p >= 0; p = h->parents[p])
+        if(p == i) return -1;
+    if(h->indices[parent] > i) MoveSubtreeToEnd(h, i);
+    i = h->indices[node];
+    h->parents[i] = h->indices[parent];
+    for(p = h->parents[i]; p >= 0 && h->ends[p] < h->ends[i];
+        p = h->parents[p])
+        h->ends[p] = h->ends[i];
+    MarkChanged(h, i);
+    return 0;
+}
+
+void SetHierarchyRotation(Hierarchy* hierarchy, int node, quat rotation)
+{
+    int i = hierarchy->indices[node];
+    if(memcmp(hierarchy->rotations[i], rotation, sizeof(quat)) == 0) return;
+    memcpy(hierarchy->rotations[i], rotation, sizeof(quat));
+    MarkChanged(hierarchy, i);
+}
+
+void SetHierarchyTranslation(Hierarchy* hierarchy, int node,
+                             vec3 translation)
+{
+    int i = hierarchy->indices[node];
+    if(memcmp(hierarchy->translations[i], translation, sizeof(vec3)) == 0)
+        return;
+    memcpy(hierarchy->translations[i], translation, sizeof(vec3));
+    MarkChanged(hierarchy, i);
+}
+
+//Computes the world transform of the node at index i from its parent's.
+static void UpdateIndex(Hierarchy* h, int i)
+{
+    mat4x4 local_matrix;
+    mat4x4_from_quat(local_matrix, h->rotations[i]);
+    mat4x4_translate_in_place(local_matrix,
+                              h->translations[i][0],
+                              h->translations[i][1],
+                              h->translations[i][2]);
+    int p = h->parents[i];
+    if(p >= 0)
+    {
+        mat4x4_mul(h->world_matrices[i], h->world_matrices[p],
+                   local_matrix);
+        quat_mul(h->orientations[i], h->orientations[p], h->rotations[i]);
+        vec3 nt;
+        vec3_norm(nt, h->translations[i]);
+        quat_mul_vec3(nt, h->orientations[p], nt);
+        vec3_scale(nt, nt, vec3_len(h->translations[i]));
+        vec3_add(h->positions[i], h->positions[p], nt);
+    }
+    else
+    {
+        mat4x4_dup(h->world_matrices[i], local_matrix);
+        int j;
+        for(j = 0; j < 4; j++)
+            h->orientations[i][j] = h->rotations[i][j];
+        for(j = 0; j < 3; j++)
+            h->positions[i][j] = h->translations[i][j];
+    }
+}
+
+static int CompareIndex(const void* a, const void* b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+/*
+ * Recomputes the world transforms of the nodes changed since the last
+ * update and their descendants. The changed nodes are visited front to
+ * back, scanning only as far as their subtrees reach, and a node is
+ * recomputed if it changed or its parent was recomputed in this pass.
+ */
+void UpdateHierarchy(Hierarchy* hierarchy)
+{
+    Hierarchy* h = hierarchy;
+    if(h->dirty_count == 0) return;
+    qsort(h->dirty, h->dirty_count, sizeof(int), CompareIndex);
+    h->pass++;
+    int k, i, end = -1;
+    for(k = 0; k < h->dirty_count; k++)
+    {
+        if(h->dirty[k] <= end) continue; //Scanned already
+        for(i = h->dirty[k], end = i; i <= end; i++)
+        {
+            int p = h->parents[i];
+            if(!h->changed[i] && (p < 0 || h->passes[p] != h->pass))
+                continue;
+            UpdateIndex(h, i);
+            h->changed[i] = 0;
+            h->passes[i] = h->pass;
+            if(h->ends[i] > end) end = h->ends[i];
+        }
+    }
+    h->dirty_count = 0;
+}
+
+void DestroyHierarchy(Hierarchy* hierarchy)
+{
+    free(hierarchy->parents);
+    free(hierarchy->rotations);
+    free(hierarchy->translations);
+    free(hierarchy->world_matrices);
+    free(hierarchy->orientations);
+    free(hierarchy->positions);
+    free(hierarchy->ids);
+    free(hierarchy->indices);
+    free(hierarchy->ends);
+    free(hierarchy->changed);
+    free(hierarchy->passes);
+    free(hierarchy->dirty);
+    free(hierarchy->marks);
+    ConstructHierarchy(hierarchy);
+}
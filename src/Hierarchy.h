@@ -0,0 +1,47 @@
+#ifndef HIERARCHY_H_
+#define HIERARCHY_H_
+
+#include <linmath.h>
+
+/*
+ * Transform hierarchy kept as parallel arrays, with every node stored after
+ * its parent, so world transforms are updated in one pass front to back
+ * without following pointers. Nodes are referred to by ids, which stay the
+ * same when nodes are moved around in the arrays to keep that order. Nodes
+ * are rotated, then translated relative to their parent.
+ *
+ * Local transforms are set through SetHierarchyRotation and
+ * SetHierarchyTranslation, which note the nodes that changed.
+ * UpdateHierarchy then only recomputes those and their descendants, so
+ * nodes that don't move cost nothing.
+ */
+typedef struct
+{
+    int count, capacity;
+    int* parents;         //Index of the parent, -1 for roots
+    quat* rotations;      //Local
+    vec3* translations;   //Local
+    mat4x4* world_matrices;
+    quat* orientations;   //World
+    vec3* positions;      //World
+    int* ids;             //Id of the node at each index
+    int* indices;         //Index of each id
+    int* ends;            //No descendant is stored after this index
+    char* changed;        //Local transform set since the last update
+    unsigned int* passes; //Update pass that last recomputed each node
+    unsigned int pass;
+    int* dirty;           //Indices of the changed nodes
+    int dirty_count;
+    char* marks;          //Scratch for finding subtrees
+} Hierarchy;
+
+void ConstructHierarchy(Hierarchy* hierarchy);
+int AddHierarchyNode(Hierarchy* hierarchy);
+int SetHierarchyParent(Hierarchy* hierarchy, int node, int parent);
+void SetHierarchyRotation(Hierarchy* hierarchy, int node, quat rotation);
+void SetHierarchyTranslation(Hierarchy* hierarchy, int node,
+                             vec3 translation);
+void UpdateHierarchy(Hierarchy* hierarchy);
+void DestroyHierarchy(Hierarchy* hierarchy);
+
+#endif
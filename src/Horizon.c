@@ -0,0 +1,124 @@
+#include "Horizon.h"
+#include <math.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+void ClearHorizon(Horizon* horizon, vec3 eye)
+{
+    int i;
+    for(i = 0; i < HORIZON_BUCKETS; i++) horizon->slopes[i] = -INFINITY;
+    for(i = 0; i < 3; i++) horizon->eye[i] = eye[i];
+}
+
+/*
+ * Finds the horizontal distance range of a box from the eye and the
+ * azimuth range it covers, in buckets. Returns 0 if the eye is above or
+ * below the box, where the box covers every azimuth.
+ */
+static int BoxSpan(Horizon* horizon, vec3 min, vec3 max, float* nearest,
+                   float* farthest, float* first, float* last)
+{
+    float* eye = horizon->eye;
+    float dx = fmaxf(fmaxf(min[0] - eye[0], 0.f), eye[0] - max[0]);
+    float dz = fmaxf(fmaxf(min[2] - eye[2], 0.f), eye[2] - max[2]);
+    *nearest = sqrtf(dx*dx + dz*dz);
+    if(*nearest <= 0.f) return 0;
+    dx = fmaxf(fabsf(min[0] - eye[0]), fabsf(max[0] - eye[0]));
+    dz = fmaxf(fabsf(min[2] - eye[2]), fabsf(max[2] - eye[2]));
+    *farthest = sqrtf(dx*dx + dz*dz);
+
+    //Corner angles relative to the centre one, which stay within a half
+    //turn since the eye is outside the box.
+    float center = atan2f((min[2] + max[2])/2.f - eye[2],
+                          (min[0] + max[0])/2.f - eye[0]);
+    float lo = 0.f, hi = 0.f;
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        float x = (i & 1 ? max[0] : min[0]) - eye[0];
+        float z = (i & 2 ? max[2] : min[2]) - eye[2];
+        float a = atan2f(z, x) - center;
+        if(a > (float)M_PI) a -= 2.f*(float)M_PI;
+        else if(a < -(float)M_PI) a += 2.f*(float)M_PI;
+        lo = fminf(lo, a);
+        hi = fmaxf(hi, a);
+    }
+    float scale = HORIZON_BUCKETS / (2.f*(float)M_PI);
+    *first = (center + lo + (float)M_PI) * scale;
+    *last = (center + hi + (float)M_PI) * scale;
+    return 1;
+}
+
+static void RaiseBuckets(float* slopes, int first, int count, float slope)
+{
+    int i = first;
+#ifdef __SSE__
+    __m128 s = _mm_set1_ps(slope);
+    for(; i + 4 <= first + count; i += 4)
+        _mm_storeu_ps(slopes + i, _mm_max_ps(_mm_loadu_ps(slopes + i), s));
+#endif
+    for(; i < first + count; i++) slopes[i] = fmaxf(slopes[i], slope);
+}
+
+static float LowestBucket(const float* slopes, int first, int count)
+{
+    float lowest = INFINITY;
+    int i = first;
+#ifdef __SSE__
+    __m128 m = _mm_set1_ps(INFINITY);
+    for(; i + 4 <= first + count; i += 4)
+        m = _mm_min_ps(m, _mm_loadu_ps(slopes + i));
+    m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+    lowest = _mm_cvtss_f32(m);
+#endif
+    for(; i < first + count; i++) lowest = fminf(lowest, slopes[i]);
+    return lowest;
+}
+
+static int Wrap(int a)
+{
+    a %= HORIZON_BUCKETS;
+    return a < 0 ? a + HORIZON_BUCKETS : a;
+}
+
+/*
+ * Raises the horizon to cover a box whose ground reaches at least min[1]
+ * everywhere in it. Only buckets that lie entirely within the box azimuth
+ * range are raised, to the lowest slope a ray through the box can have
+ * while passing below min[1] somewhere inside it.
+ */
+void RaiseHorizon(Horizon* horizon, vec3 min, vec3 max)
+{
+    float nearest, farthest, first, last;
+    if(!BoxSpan(horizon, min, max, &nearest, &farthest, &first, &last))
+        return;
+    float height = min[1] - horizon->eye[1];
+    float slope = height / (height > 0.f ? farthest : nearest);
+    int a = (int)ceilf(first), count = (int)floorf(last) - a;
+    if(count <= 0) return;
+    int b = Wrap(a);
+    int split = HORIZON_BUCKETS - b < count ? HORIZON_BUCKETS - b : count;
+    RaiseBuckets(horizon->slopes, b, split, slope);
+    RaiseBuckets(horizon->slopes, 0, count - split, slope);
+}
+
+/*
+ * Returns 1 if the top of a box is below the horizon in every bucket it
+ * touches, so all of it is hidden by the boxes raised before.
+ */
+int HorizonHides(Horizon* horizon, vec3 min, vec3 max)
+{
+    float nearest, farthest, first, last;
+    if(!BoxSpan(horizon, min, max, &nearest, &farthest, &first, &last))
+        return 0;
+    float height = max[1] - horizon->eye[1];
+    float slope = height / (height > 0.f ? nearest : farthest);
+    int a = (int)floorf(first), count = (int)floorf(last) - a + 1;
+    int b = Wrap(a);
+    int split = HORIZON_BUCKETS - b < count ? HORIZON_BUCKETS - b : count;
+    float lowest = fminf(LowestBucket(horizon->slopes, b, split),
+                         LowestBucket(horizon->slopes, 0, count - split));
+    return slope < lowest;
+}
@@ -0,0 +1,25 @@
+#ifndef HORIZON_H_
+#define HORIZON_H_
+
+#include <linmath.h>
+
+#define HORIZON_BUCKETS 1024 //Azimuth resolution, a multiple of 4
+
+/*
+ * Occlusion culling for heightfields. For each azimuth bucket around the
+ * eye, slopes holds the steepest elevation slope (height over horizontal
+ * distance) below which the ground drawn so far hides everything behind
+ * it. Boxes must be raised in order of their farthest point, and a box may
+ * only be tested against boxes that lie entirely nearer than it.
+ */
+typedef struct
+{
+    float slopes[HORIZON_BUCKETS];
+    vec3 eye;
+} Horizon;
+
+void ClearHorizon(Horizon* horizon, vec3 eye);
+void RaiseHorizon(Horizon* horizon, vec3 min, vec3 max);
+int HorizonHides(Horizon* horizon, vec3 min, vec3 max);
+
+#endif
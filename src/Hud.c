@@ -0,0 +1,333 @@
+#include "Hud.h"
+#include "Shaders.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#define HUD_SCALE 2         //Screen pixels per font pixel
+#define HUD_GLYPH_WIDTH 6   //Font pixels per glyph in the font texture
+#define HUD_GLYPH_HEIGHT 8
+#define HUD_FIRST_GLYPH ' '
+#define HUD_GLYPHS 60       //Space to Z, then a solid block
+#define HUD_MARGIN 8
+#define HUD_LINES 6
+#define HUD_COLUMNS 34
+#define HUD_GRAPH_HEIGHT 60
+
+//5x7 glyphs from space to Z, one byte per row with the leftmost pixel in
+//bit 4. Characters without a glyph are blank.
+static const GLubyte FONT[HUD_GLYPHS - 1][7] =
+{
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //space
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //!
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //"
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //#
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //$
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, //%
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //&
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //'
+    { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, //(
+    { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, //)
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //*
+    { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 }, //+
+    { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 }, //,
+    { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, //-
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, //.
+    { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, ///
+    { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, //0
+    { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, //1
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, //2
+    { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, //3
+    { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, //4
+    { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, //5
+    { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, //6
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, //7
+    { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, //8
+    { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, //9
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, //:
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //;
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //<
+    { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 }, //=
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //>
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //?
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //@
+    { 0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11 }, //A
+    { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, //B
+    { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, //C
+    { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, //D
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, //E
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, //F
+    { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, //G
+    { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, //H
+    { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, //I
+    { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, //J
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, //K
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, //L
+    { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, //M
+    { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, //N
+    { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, //O
+    { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, //P
+    { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, //Q
+    { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, //R
+    { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, //S
+    { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, //T
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, //U
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, //V
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, //W
+    { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, //X
+    { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 }, //Y
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, //Z
+};
+
+//Lays the glyphs out in a row, followed by a solid block for the graph.
+static void SetupFont(Hud* hud)
+{
+    int width = HUD_GLYPHS*HUD_GLYPH_WIDTH;
+    GLubyte* pixels = calloc(width*HUD_GLYPH_HEIGHT, 1);
+    int g, x, y;
+    for(g = 0; g < HUD_GLYPHS; g++)
+    {
+        for(y = 0; y < HUD_GLYPH_HEIGHT; y++)
+        {
+            for(x = 0; x < HUD_GLYPH_WIDTH; x++)
+            {
+                char set = g == HUD_GLYPHS - 1 ||
+                           (x < 5 && y < 7 && (FONT[g][y] >> (4 - x) & 1));
+                pixels[y*width + g*HUD_GLYPH_WIDTH + x] = set ? 255 : 0;
+            }
+        }
+    }
+    glGenTextures(1, &hud->font);
+    glBindTexture(GL_TEXTURE_2D, hud->font);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, HUD_GLYPH_HEIGHT, 0, GL_RED,
+                 GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    free(pixels);
+}
+
+//Starts building the shaders, see FinishHud.
+void ConstructHud(Hud* hud, float budget)
+{
+    const ShaderSource sources[] = {
+        { GL_VERTEX_SHADER, "HudVertex.glsl", NULL },
+        { GL_FRAGMENT_SHADER, "HudFragment.glsl", NULL }
+    };
+    StartProgram(&hud->build, 2, sources, 0, NULL);
+    hud->program = 0;
+    SetupFont(hud);
+    glGenVertexArrays(1, &hud->vao);
+    glGenBuffers(1, &hud->vbuf);
+    glBindBuffer(GL_ARRAY_BUFFER, hud->vbuf);
+    glBufferData(GL_ARRAY_BUFFER, HUD_MAX_QUADS*6*sizeof(HudVertex), NULL,
+                 GL_STREAM_DRAW);
+    hud->vertices = malloc(HUD_MAX_QUADS*6*sizeof(HudVertex));
+    hud->quad_count = 0;
+    hud->front = 0;
+    hud->count = 0;
+    hud->budget = budget;
+}
+
+//Waits for the shaders. Returns a negative value if they can't be loaded.
+int FinishHud(Hud* hud)
+{
+    if(FinishProgram(&hud->build, &hud->program) < 0) return -1;
+    hud->screen_loc = glGetUniformLocation(hud->program, "screen");
+    hud->font_loc = glGetUniformLocation(hud->program, "font");
+    glBindVertexArray(hud->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, hud->vbuf);
+    GLint position_loc = glGetAttribLocation(hud->program, "position");
+    GLint uv_loc = glGetAttribLocation(hud->program, "uv");
+    GLint color_loc = glGetAttribLocation(hud->program, "color");
+    glEnableVertexAttribArray(position_loc);
+    glVertexAttribPointer(position_loc, 2, GL_FLOAT, GL_FALSE,
+                          sizeof(HudVertex), (void*)0);
+    glEnableVertexAttribArray(uv_loc);
+    glVertexAttribPointer(uv_loc, 2, GL_FLOAT, GL_FALSE, sizeof(HudVertex),
+                          (void*)(2*sizeof(float)));
+    glEnableVertexAttribArray(color_loc);
+    glVertexAttribPointer(color_loc, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                          sizeof(HudVertex), (void*)(4*sizeof(float)));
+    glBindVertexArray(0);
+    return 0;
+}
+
+//Adds the frame time of the frame just drawn, and what to show next.
+void UpdateHud(Hud* hud, float frametime, HudStats* stats)
+{
+    hud->history[hud->front] = frametime;
+    hud->front = (hud->front + 1) % HUD_HISTORY;
+    if(hud->count < HUD_HISTORY) hud->count++;
+    hud->stats = *stats;
+}
+
+static void SetQuad(Hud* hud, int quad, float x0, float y0, float x1,
+                    float y1, float u0, float v0, float u1, float v1,
+                    const GLubyte color[4])
+{
+    static const int corners[6] = { 0, 2, 1, 1, 2, 3 };
+    HudVertex* v = hud->vertices + quad*6;
+    int i, j;
+    for(i = 0; i < 6; i++)
+    {
+        v[i].x = corners[i] & 1 ? x1 : x0;
+        v[i].y = corners[i] & 2 ? y1 : y0;
+        v[i].u = corners[i] & 1 ? u1 : u0;
+        v[i].v = corners[i] & 2 ? v1 : v0;
+        for(j = 0; j < 4; j++) v[i].color[j] = color[j];
+    }
+}
+
+static void PushRect(Hud* hud, float x0, float y0, float x1, float y1,
+                     const GLubyte color[4])
+{
+    if(hud->quad_count == HUD_MAX_QUADS) return;
+    float u = (HUD_GLYPHS - 1)*HUD_GLYPH_WIDTH + 0.5f;
+    SetQuad(hud, hud->quad_count++, x0, y0, x1, y1, u, 0.5f, u, 0.5f, color);
+}
+
+//Returns the x coordinate after the text.
+static float PushText(Hud* hud, float x, float y, const char* text,
+                      const GLubyte color[4])
+{
+    for(; *text; text++, x += HUD_GLYPH_WIDTH*HUD_SCALE)
+    {
+        int c = toupper((unsigned char)*text);
+        if(c <= HUD_FIRST_GLYPH || c >= HUD_FIRST_GLYPH + HUD_GLYPHS - 1 ||
+           hud->quad_count == HUD_MAX_QUADS)
+            continue;
+        float u = (c - HUD_FIRST_GLYPH)*HUD_GLYPH_WIDTH;
+        SetQuad(hud, hud->quad_count++, x, y, x + 5*HUD_SCALE,
+                y + 7*HUD_SCALE, u, 0.f, u + 5.f, 7.f, color);
+    }
+    return x;
+}
+
+//Formats a value, or a dash if it is negative, i.e. unavailable.
+static void FormatValue(char* dst, size_t size, const char* format,
+                        double value)
+{
+    if(value < 0.) snprintf(dst, size, "-");
+    else snprintf(dst, size, format, value);
+}
+
+//Resident memory of the process in bytes, or -1 where unknown.
+static double ResidentMemory()
+{
+#ifdef __linux__
+    FILE* f = fopen("/proc/self/statm", "r");
+    if(!f) return -1.;
+    long size, resident;
+    int fields = fscanf(f, "%ld %ld", &size, &resident);
+    fclose(f);
+    if(fields != 2) return -1.;
+    return (double)resident*sysconf(_SC_PAGESIZE);
+#else
+    return -1.;
+#endif
+}
+
+static void BuildHud(Hud* hud)
+{
+    static const GLubyte background[4] = { 0, 0, 0, 160 };
+    static const GLubyte white[4] = { 255, 255, 255, 255 };
+    static const GLubyte good[4] = { 64, 224, 64, 255 };
+    static const GLubyte bad[4] = { 240, 64, 48, 255 };
+    static const GLubyte line[4] = { 255, 255, 255, 128 };
+    HudStats* s = &hud->stats;
+    char text[HUD_LINES][96], a[32], b[32];
+    int i;
+
+    double sum = 0.;
+    for(i = 0; i < hud->count; i++) sum += hud->history[i];
+    float last = hud->history[(hud->front + HUD_HISTORY - 1) % HUD_HISTORY];
+    snprintf(text[0], sizeof(text[0]), "FPS %.1f  FRAME %.2f MS",
+             sum > 0. ? hud->count / sum : 0., last*1000.f);
+    FormatValue(a, sizeof(a), "%.2f", s->gputime*1000.);
+    snprintf(text[1], sizeof(text[1]), "CPU %.2f MS  GPU %s MS",
+             s->cputime*1000.f, a);
+    FormatValue(a, sizeof(a), "%.1fK", s->triangles/1e3);
+    snprintf(text[2], sizeof(text[2]), "TRIANGLES %s", a);
+    FormatValue(a, sizeof(a), "%.0f", s->terrain.resident);
+    snprintf(text[3], sizeof(text[3]), "TILES %d  RESIDENT %s  PENDING %d",
+             s->terrain.tiles, a, s->terrain.pending);
+    FormatValue(a, sizeof(a), "%.1f%%", s->terrain.hit_rate*100.);
+    snprintf(text[4], sizeof(text[4]), "CACHE HIT %s", a);
+    FormatValue(a, sizeof(a), "%.1f", ResidentMemory()/1048576.);
+    FormatValue(b, sizeof(b), "%.1f", s->terrain.cache_bytes/1048576.);
+    snprintf(text[5], sizeof(text[5]), "MEMORY %s MB  TILE CACHE %s MB",
+             a, b);
+
+    //The background is the first quad, sized once the text is laid out.
+    hud->quad_count = 1;
+    float x = HUD_MARGIN, y = HUD_MARGIN, right = HUD_MARGIN + HUD_HISTORY;
+    for(i = 0; i < HUD_LINES; i++)
+    {
+        float end = PushText(hud, x, y, text[i], white);
+        if(end > right) right = end;
+        y += (HUD_GLYPH_HEIGHT + 2)*HUD_SCALE;
+    }
+
+    //Frame times, oldest on the left, up to twice the budget.
+    y += HUD_MARGIN;
+    float bottom = y + HUD_GRAPH_HEIGHT;
+    for(i = 0; i < hud->count; i++)
+    {
+        int index = (hud->front + HUD_HISTORY - hud->count + i) % HUD_HISTORY;
+        float t = hud->history[index] * 1000.f;
+        float h = t / (2.f*hud->budget) * HUD_GRAPH_HEIGHT;
+        if(h > HUD_GRAPH_HEIGHT) h = HUD_GRAPH_HEIGHT;
+        PushRect(hud, x + HUD_HISTORY - hud->count + i, bottom - h,
+                 x + HUD_HISTORY - hud->count + i + 1, bottom,
+                 t > hud->budget ? bad : good);
+    }
+    PushRect(hud, x, bottom - HUD_GRAPH_HEIGHT/2, x + HUD_HISTORY,
+             bottom - HUD_GRAPH_HEIGHT/2 + 1, line);
+
+    float u = (HUD_GLYPHS - 1)*HUD_GLYPH_WIDTH + 0.5f;
+    SetQuad(hud, 0, 0.f, 0.f, right + HUD_MARGIN, bottom + HUD_MARGIN,
+            u, 0.5f, u, 0.5f, background);
+}
+
+/*
+ * Draws the overlay over whatever is in the framebuffer, in one draw call.
+ * width and height are the size of the framebuffer in pixels.
+ */
+void DrawHud(Hud* hud, RenderState* state, int width, int height)
+{
+    BuildHud(hud);
+    glBindBuffer(GL_ARRAY_BUFFER, hud->vbuf);
+    glBufferData(GL_ARRAY_BUFFER, HUD_MAX_QUADS*6*sizeof(HudVertex), NULL,
+                 GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, hud->quad_count*6*sizeof(HudVertex),
+                    hud->vertices);
+
+    GLint unit = 0;
+    UseProgram(state, hud->program);
+    SetUniform(state, hud->program, UNIFORM_INT, hud->font_loc, &unit);
+    glUniform2f(hud->screen_loc, width, height);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, hud->font);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    BindVertexArray(state, hud->vao);
+    glDrawArrays(GL_TRIANGLES, 0, hud->quad_count*6);
+    glDisable(GL_BLEND);
+    glEnable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void DestroyHud(Hud* hud)
+{
+    FinishProgram(&hud->build, NULL);
+    glDeleteProgram(hud->program);
+    glDeleteVertexArrays(1, &hud->vao);
+    glDeleteBuffers(1, &hud->vbuf);
+    glDeleteTextures(1, &hud->font);
+    free(hud->vertices);
+}
@@ -0,0 +1,50 @@
+#ifndef HUD_H_
+#define HUD_H_
+
+#include <glad/glad.h>
+#include "Render.h"
+#include "Terrain.h"
+#include "Shaders.h"
+
+#define HUD_HISTORY 240  //Frames in the frame time graph
+#define HUD_MAX_QUADS 1024
+
+//What the HUD shows besides the frame times. Negative means unavailable.
+typedef struct
+{
+    float cputime;
+    double gputime, triangles;
+    TerrainStats terrain;
+} HudStats;
+
+typedef struct
+{
+    float x, y, u, v;
+    GLubyte color[4];
+} HudVertex;
+
+/*
+ * Performance overlay in the top left corner, with text in a built-in
+ * bitmap font and a graph of the recent frame times. Everything is
+ * batched into quads of one vertex buffer and drawn in one call.
+ */
+typedef struct
+{
+    GLuint program, vao, vbuf, font;
+    GLint screen_loc, font_loc;
+    HudVertex* vertices;
+    int quad_count;
+    float history[HUD_HISTORY];
+    int front, count;
+    float budget;
+    HudStats stats;
+    ProgramBuild build; //Until FinishHud
+} Hud;
+
+void ConstructHud(Hud* hud, float budget);
+int FinishHud(Hud* hud);
+void UpdateHud(Hud* hud, float frametime, HudStats* stats);
+void DrawHud(Hud* hud, RenderState* state, int width, int height);
+void DestroyHud(Hud* hud);
+
+#endif
@@ -0,0 +1,344 @@
+#include "Impostor.h"
+#include "Terrain.h"
+#include "Frustum.h"
+#include "Shaders.h"
+#include <stdlib.h>
+#include <math.h>
+
+#define IMPOSTOR_STEP 4 //Grid spacing of far tiles
+
+static const GLfloat CUBE_CORNERS[] =
+{
+    -1.f, -1.f, -1.f,  1.f, -1.f, -1.f,  -1.f, 1.f, -1.f,  1.f, 1.f, -1.f,
+    -1.f, -1.f, 1.f,  1.f, -1.f, 1.f,  -1.f, 1.f, 1.f,  1.f, 1.f, 1.f
+};
+
+static const GLubyte CUBE_INDICES[] =
+{
+    0, 1, 2,  2, 1, 3,  4, 6, 5,  5, 6, 7,
+    0, 2, 4,  4, 2, 6,  1, 5, 3,  3, 5, 7,
+    0, 4, 1,  1, 4, 5,  2, 3, 6,  6, 3, 7
+};
+
+//View direction and up vector of each cubemap face, in GL face order.
+static const float FACES[6][2][3] =
+{
+    { { 1.f, 0.f, 0.f }, { 0.f, -1.f, 0.f } },
+    { { -1.f, 0.f, 0.f }, { 0.f, -1.f, 0.f } },
+    { { 0.f, 1.f, 0.f }, { 0.f, 0.f, 1.f } },
+    { { 0.f, -1.f, 0.f }, { 0.f, 0.f, -1.f } },
+    { { 0.f, 0.f, 1.f }, { 0.f, -1.f, 0.f } },
+    { { 0.f, 0.f, -1.f }, { 0.f, -1.f, 0.f } }
+};
+
+static void SetupSky(Impostor* impostor)
+{
+    const ShaderSource sources[] = {
+        { GL_VERTEX_SHADER, "ImpostorVertex.glsl", NULL },
+        { GL_FRAGMENT_SHADER, "ImpostorFragment.glsl", NULL }
+    };
+    StartProgram(&impostor->build, 2, sources, 0, NULL);
+    impostor->sky_program = 0;
+
+    glGenVertexArrays(1, &impostor->cube_vao);
+    glBindVertexArray(impostor->cube_vao);
+    glGenBuffers(1, &impostor->cube_vbuf);
+    glBindBuffer(GL_ARRAY_BUFFER, impostor->cube_vbuf);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(CUBE_CORNERS), CUBE_CORNERS,
+                 GL_STATIC_DRAW);
+    glGenBuffers(1, &impostor->cube_ibuf);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, impostor->cube_ibuf);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(CUBE_INDICES), CUBE_INDICES,
+                 GL_STATIC_DRAW);
+    glBindVertexArray(0);
+}
+
+static int FinishSkyProgram(Impostor* impostor)
+{
+    if(FinishProgram(&impostor->build, &impostor->sky_program) < 0)
+        return -1;
+    GLuint program = impostor->sky_program;
+    impostor->sky_view_projection_loc =
+        glGetUniformLocation(program, "view_projection");
+    impostor->sky_panorama_loc = glGetUniformLocation(program, "panorama");
+    glBindVertexArray(impostor->cube_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, impostor->cube_vbuf);
+    GLint corner_loc = glGetAttribLocation(program, "corner");
+    glEnableVertexAttribArray(corner_loc);
+    glVertexAttribPointer(corner_loc, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindVertexArray(0);
+    return 0;
+}
+
+static void SetupPanorama(Impostor* impostor)
+{
+    int i;
+    glGenTextures(1, &impostor->cubemap);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, impostor->cubemap);
+    for(i = 0; i < 6; i++)
+    {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB8,
+                     impostor->size, impostor->size, 0, GL_RGB,
+                     GL_UNSIGNED_BYTE, NULL);
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S,
+                    GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T,
+                    GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R,
+                    GL_CLAMP_TO_EDGE);
+    if(GLAD_GL_VERSION_3_2) glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    glGenRenderbuffers(1, &impostor->depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, impostor->depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24,
+                          impostor->size, impostor->size);
+    GLint framebuffer;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    glGenFramebuffers(1, &impostor->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, impostor->fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, impostor->depth);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+/*
+ * Changes the program the far tiles are rendered with, and renders the
+ * panorama again with it on the next update. Its color and fog uniforms
+ * are set by the caller.
+ */
+void SetImpostorProgram(Impostor* impostor, GLuint program)
+{
+    impostor->program = program;
+    impostor->world_mat_loc = glGetUniformLocation(program, "world_mat");
+    impostor->view_mat_loc = glGetUniformLocation(program, "view_mat");
+    impostor->proj_mat_loc = glGetUniformLocation(program, "proj_mat");
+    impostor->viewdistance_loc = glGetUniformLocation(program,
+                                                      "viewdistance");
+    glBindVertexArray(impostor->mesh_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, impostor->mesh_vbuf);
+    GLint pos_loc = glGetAttribLocation(program, "grid_pos");
+    glEnableVertexAttribArray(pos_loc);
+    glVertexAttribPointer(pos_loc, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, impostor->mesh_ibuf);
+    glBindVertexArray(0);
+    impostor->valid = 0;
+}
+
+/*
+ * Sets up a panorama of size by size pixels per face, and starts building
+ * the program drawing it, see FinishImpostor.
+ */
+void ConstructImpostor(Impostor* impostor, int size, float far, float move,
+                       float error)
+{
+    SetupSky(impostor);
+
+    int n = TERRAIN_TILE_SIZE / IMPOSTOR_STEP + 1;
+    impostor->mesh_vbuf = CreateGridVertexBuffer(n, IMPOSTOR_STEP);
+    impostor->mesh_ibuf = CreateGridIndexBuffer(&impostor->icount, n);
+    glGenVertexArrays(1, &impostor->mesh_vao);
+    impostor->program = 0;
+
+    int r = (int)ceil(far / TERRAIN_TILE_SIZE);
+    glGenBuffers(1, &impostor->tile_buf);
+    glBindBuffer(GL_TEXTURE_BUFFER, impostor->tile_buf);
+    glBufferData(GL_TEXTURE_BUFFER, (2*r+1)*(2*r+1)*2*sizeof(float), NULL,
+                 GL_STREAM_DRAW);
+    glGenTextures(1, &impostor->tile_tex);
+    glBindTexture(GL_TEXTURE_BUFFER, impostor->tile_tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, impostor->tile_buf);
+    impostor->origins = malloc((2*r+1)*(2*r+1)*2*sizeof(float));
+
+    impostor->size = size;
+    SetupPanorama(impostor);
+    impostor->inner = 0.f;
+    impostor->near = 0.f;
+    impostor->far = far;
+    impostor->move = move;
+    impostor->error = error;
+    impostor->valid = 0;
+    impostor->refreshes = 0;
+}
+
+/*
+ * Waits for the panorama program. program is a terrain program fetching
+ * tile origins by gl_InstanceID, which is used to render the far tiles with
+ * a coarser mesh. Its color and fog uniforms are set by the caller. Returns
+ * a negative value if the panorama program failed.
+ */
+int FinishImpostor(Impostor* impostor, GLuint program)
+{
+    if(FinishSkyProgram(impostor) < 0) return -1;
+    SetImpostorProgram(impostor, program);
+    return 0;
+}
+
+/*
+ * Sets the radius the near terrain is drawn to. The panorama starts move
+ * units closer, so it still meets the near terrain when the camera has
+ * moved away from the panorama center.
+ */
+void SetImpostorRange(Impostor* impostor, float near)
+{
+    float inner = fmaxf(near - impostor->move, TERRAIN_TILE_SIZE);
+    impostor->near = near;
+    if(inner == impostor->inner) return;
+    impostor->inner = inner;
+    impostor->valid = 0;
+}
+
+//Renders the far tiles seen through one face of the cubemap.
+static void RenderFace(Impostor* impostor, RenderState* state, int face)
+{
+    float* center = impostor->center;
+    vec3 target;
+    int i;
+    for(i = 0; i < 3; i++) target[i] = center[i] + FACES[face][0][i];
+    mat4x4 view, projection, view_projection;
+    mat4x4_look_at(view, center, target, (float*)FACES[face][1]);
+    mat4x4_perspective(projection, (float)M_PI/2.f, 1.f, 1.f,
+                       impostor->far*2.f);
+    mat4x4_mul(view_projection, projection, view);
+    Frustum frustum;
+    ExtractFrustum(&frustum, view_projection);
+
+    int r = (int)ceil(impostor->far / TERRAIN_TILE_SIZE);
+    int cx = (int)floor(center[0] / TERRAIN_TILE_SIZE);
+    int cz = (int)floor(center[2] / TERRAIN_TILE_SIZE);
+    int x, z, count = 0;
+    for(x = cx - r; x <= cx + r; x++)
+    {
+        for(z = cz - r; z <= cz + r; z++)
+        {
+            vec3 min = { x*TERRAIN_TILE_SIZE, TERRAIN_MIN_HEIGHT,
+                         z*TERRAIN_TILE_SIZE };
+            vec3 max = { min[0] + TERRAIN_TILE_SIZE, TERRAIN_MAX_HEIGHT,
+                         min[2] + TERRAIN_TILE_SIZE };
+            float dx = fmaxf(fmaxf(min[0] - center[0], 0.f),
+                             center[0] - max[0]);
+            float dz = fmaxf(fmaxf(min[2] - center[2], 0.f),
+                             center[2] - max[2]);
+            float distance = sqrtf(dx*dx + dz*dz);
+            if(distance < impostor->inner || distance > impostor->far)
+                continue;
+            if(!BoxInFrustum(&frustum, min, max)) continue;
+            impostor->origins[2*count] = min[0];
+            impostor->origins[2*count+1] = min[2];
+            count++;
+        }
+    }
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                           impostor->cubemap, 0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if(count == 0) return;
+    glBindBuffer(GL_TEXTURE_BUFFER, impostor->tile_buf);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, count*2*sizeof(float),
+                    impostor->origins);
+    SetUniform(state, impostor->program, UNIFORM_MAT4,
+               impostor->view_mat_loc, view);
+    SetUniform(state, impostor->program, UNIFORM_MAT4,
+               impostor->proj_mat_loc, projection);
+    //Uniforms already set are skipped without binding the program.
+    UseProgram(state, impostor->program);
+    BindVertexArray(state, impostor->mesh_vao);
+    glDrawElementsInstanced(GL_TRIANGLE_STRIP, impostor->icount,
+                            GL_UNSIGNED_INT, NULL, count);
+}
+
+/*
+ * Renders the panorama again around position if the camera has moved too
+ * far from its center. pixel_angle is the angle covered by one pixel on
+ * screen, for the parallax test, which is off when error is 0. Returns 1 if
+ * the panorama was rendered.
+ */
+int UpdateImpostor(Impostor* impostor, RenderState* state, vec3 position,
+                   float pixel_angle)
+{
+    if(impostor->valid)
+    {
+        vec3 offset;
+        vec3_sub(offset, position, impostor->center);
+        float moved = vec3_len(offset);
+        //The closest panorama terrain left uncovered is at the near range.
+        float parallax = atanf(moved / impostor->near) / pixel_angle;
+        if(moved < impostor->move &&
+           (impostor->error <= 0.f || parallax < impostor->error))
+            return 0;
+    }
+    int i;
+    for(i = 0; i < 3; i++) impostor->center[i] = position[i];
+
+    GLint viewport[4], framebuffer;
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    glViewport(0, 0, impostor->size, impostor->size);
+    glBindFramebuffer(GL_FRAMEBUFFER, impostor->fbo);
+    mat4x4 identity;
+    mat4x4_identity(identity);
+    SetUniform(state, impostor->program, UNIFORM_MAT4,
+               impostor->world_mat_loc, identity);
+    SetUniform(state, impostor->program, UNIFORM_FLOAT,
+               impostor->viewdistance_loc, &impostor->far);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, impostor->tile_tex);
+    for(i = 0; i < 6; i++) RenderFace(impostor, state, i);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    impostor->valid = 1;
+    impostor->refreshes++;
+    return 1;
+}
+
+/*
+ * Draws the panorama at the far plane. Call after the near terrain, so the
+ * depth test skips every pixel it already covers.
+ */
+void DrawImpostor(Impostor* impostor, RenderState* state,
+                  mat4x4 projection, mat4x4 view)
+{
+    mat4x4 rotation, view_projection;
+    mat4x4_dup(rotation, view);
+    rotation[3][0] = rotation[3][1] = rotation[3][2] = 0.f;
+    mat4x4_mul(view_projection, projection, rotation);
+    SetUniform(state, impostor->sky_program, UNIFORM_MAT4,
+               impostor->sky_view_projection_loc, view_projection);
+    GLint unit = 1;
+    SetUniform(state, impostor->sky_program, UNIFORM_INT,
+               impostor->sky_panorama_loc, &unit);
+    UseProgram(state, impostor->sky_program);
+    BindVertexArray(state, impostor->cube_vao);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, impostor->cubemap);
+    glActiveTexture(GL_TEXTURE0);
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+    glDrawElements(GL_TRIANGLES, sizeof(CUBE_INDICES), GL_UNSIGNED_BYTE,
+                   NULL);
+    glEnable(GL_CULL_FACE);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+}
+
+void DestroyImpostor(Impostor* impostor)
+{
+    FinishProgram(&impostor->build, NULL);
+    glDeleteProgram(impostor->sky_program);
+    glDeleteVertexArrays(1, &impostor->cube_vao);
+    glDeleteBuffers(1, &impostor->cube_vbuf);
+    glDeleteBuffers(1, &impostor->cube_ibuf);
+    glDeleteVertexArrays(1, &impostor->mesh_vao);
+    glDeleteBuffers(1, &impostor->mesh_vbuf);
+    glDeleteBuffers(1, &impostor->mesh_ibuf);
+    glDeleteTextures(1, &impostor->tile_tex);
+    glDeleteBuffers(1, &impostor->tile_buf);
+    free(impostor->origins);
+    glDeleteFramebuffers(1, &impostor->fbo);
+    glDeleteRenderbuffers(1, &impostor->depth);
+    glDeleteTextures(1, &impostor->cubemap);
+}
@@ -0,0 +1,49 @@
+#ifndef IMPOSTOR_H_
+#define IMPOSTOR_H_
+
+#include <glad/glad.h>
+#include <linmath.h>
+#include "Render.h"
+#include "Shaders.h"
+
+/*
+ * Far terrain rendered into a cubemap around a center point and drawn
+ * behind the near terrain. The panorama covers tiles from inner out to far
+ * from the center, and is rendered again when the camera has moved move
+ * units from it, or when the parallax of the nearest visible panorama terrain
+ * would exceed error pixels.
+ */
+typedef struct
+{
+    GLuint program;
+    GLint world_mat_loc, view_mat_loc, proj_mat_loc;
+    GLint viewdistance_loc;
+    GLuint mesh_vbuf, mesh_ibuf, mesh_vao;
+    int icount;
+    GLuint tile_buf, tile_tex;
+    float* origins;
+    GLuint sky_program;
+    GLint sky_view_projection_loc, sky_panorama_loc;
+    GLuint cube_vao, cube_vbuf, cube_ibuf;
+    GLuint fbo, cubemap, depth;
+    int size;
+    float inner, near, far;
+    float move, error;
+    vec3 center;
+    char valid;
+    int refreshes;
+    ProgramBuild build; //Panorama program, until FinishImpostor
+} Impostor;
+
+void ConstructImpostor(Impostor* impostor, int size, float far, float move,
+                       float error);
+int FinishImpostor(Impostor* impostor, GLuint program);
+void SetImpostorProgram(Impostor* impostor, GLuint program);
+void SetImpostorRange(Impostor* impostor, float near);
+int UpdateImpostor(Impostor* impostor, RenderState* state, vec3 position,
+                   float pixel_angle);
+void DrawImpostor(Impostor* impostor, RenderState* state,
+                  mat4x4 projection, mat4x4 view);
+void DestroyImpostor(Impostor* impostor);
+
+#endif
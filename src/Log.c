@@ -0,0 +1,198 @@
+#include "Log.h"
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+
+/*
+ * Slot of the queue. sequence tells whose turn it is: the slot is free for
+ * the producer at position p when it equals p, and holds the message at p
+ * for the writer when it equals p + 1.
+ */
+typedef struct
+{
+    unsigned long sequence;
+    LogLevel level;
+    double time;
+    char text[LOG_MESSAGE];
+} LogEntry;
+
+static const char* LEVEL_NAMES[] = { "debug", "info", "warning", "error" };
+
+static LogEntry entries[LOG_QUEUE];
+static unsigned long enqueue_position, dequeue_position;
+static unsigned long dropped;
+static LogLevel level = LOG_INFO;
+static char running, stopping;
+static int writers; //Calls to Log that may still publish a message
+static FILE* file;
+static SDL_Thread* thread;
+static SDL_sem* wake;
+static struct timespec start;
+
+static double Elapsed()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec)*1e-9;
+}
+
+static void Write(FILE* f, double time, LogLevel l, const char* text)
+{
+    fprintf(f, "[%10.3f] %s: %s\n", time, LEVEL_NAMES[l], text);
+}
+
+//Writes every queued message. Only the writer thread, or DestroyLog once it
+//has stopped, may call this.
+static void Drain()
+{
+    FILE* f = __atomic_load_n(&file, __ATOMIC_ACQUIRE);
+    for(;;)
+    {
+        LogEntry* e = &entries[dequeue_position & (LOG_QUEUE - 1)];
+        if(__atomic_load_n(&e->sequence, __ATOMIC_ACQUIRE) !=
+           dequeue_position + 1)
+            break;
+        Write(stderr, e->time, e->level, e->text);
+        if(f) Write(f, e->time, e->level, e->text);
+        __atomic_store_n(&e->sequence, dequeue_position + LOG_QUEUE,
+                         __ATOMIC_RELEASE);
+        dequeue_position++;
+    }
+    unsigned long lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+    if(lost > 0)
+    {
+        char text[64];
+        snprintf(text, sizeof(text), "%lu messages dropped, the log queue "
+                 "was full.", lost);
+        Write(stderr, Elapsed(), LOG_WARNING, text);
+        if(f) Write(f, Elapsed(), LOG_WARNING, text);
+    }
+    if(f) fflush(f);
+}
+
+static int WriterThread(void* data)
+{
+    (void)data;
+    for(;;)
+    {
+        SDL_SemWait(wake);
+        char stop = __atomic_load_n(&stopping, __ATOMIC_ACQUIRE);
+        Drain();
+        if(stop) return 0;
+    }
+}
+
+/*
+ * Starts the writer thread. Messages are flushed at exit even if
+ * DestroyLog isn't called. Returns -1 if the thread can't be started, in
+ * which case messages keep going to stderr directly.
+ */
+int InitLog()
+{
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    unsigned long i;
+    for(i = 0; i < LOG_QUEUE; i++) entries[i].sequence = i;
+    enqueue_position = dequeue_position = 0;
+    stopping = 0;
+    wake = SDL_CreateSemaphore(0);
+    if(!wake) return -1;
+    thread = SDL_CreateThread(WriterThread, "Log", NULL);
+    if(!thread)
+    {
+        SDL_DestroySemaphore(wake);
+        return -1;
+    }
+    __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+    atexit(DestroyLog);
+    return 0;
+}
+
+//Drops messages below level from now on.
+void SetLogLevel(LogLevel l)
+{
+    __atomic_store_n(&level, l, __ATOMIC_RELAXED);
+}
+
+/*
+ * Appends messages to a file as well as stderr, from the next one written.
+ * Only call once. Returns -1 if the file can't be opened.
+ */
+int OpenLogFile(const char* path)
+{
+    FILE* f = fopen(path, "a");
+    if(!f) return -1;
+    __atomic_store_n(&file, f, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void Log(LogLevel l, const char* format, ...)
+{
+    if(l < __atomic_load_n(&level, __ATOMIC_RELAXED)) return;
+    va_list args;
+    va_start(args, format);
+    //DestroyLog waits for writers that saw it running before draining.
+    __atomic_add_fetch(&writers, 1, __ATOMIC_SEQ_CST);
+    if(!__atomic_load_n(&running, __ATOMIC_SEQ_CST))
+    {
+        __atomic_sub_fetch(&writers, 1, __ATOMIC_RELEASE);
+        char text[LOG_MESSAGE];
+        vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        Write(stderr, Elapsed(), l, text);
+        return;
+    }
+
+    //Claim a slot, or give up if the writer hasn't freed the oldest yet.
+    unsigned long position = __atomic_load_n(&enqueue_position,
+                                             __ATOMIC_RELAXED);
+    LogEntry* e;
+    for(;;)
+    {
+        e = &entries[position & (LOG_QUEUE - 1)];
+        long diff = (long)(__atomic_load_n(&e->sequence, __ATOMIC_ACQUIRE) -
+                           position);
+        if(diff == 0)
+        {
+            if(__atomic_compare_exchange_n(&enqueue_position, &position,
+                                           position + 1, 1, __ATOMIC_RELAXED,
+                                           __ATOMIC_RELAXED))
+                break;
+        }
+        else if(diff < 0)
+        {
+            va_end(args);
+            __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+            __atomic_sub_fetch(&writers, 1, __ATOMIC_RELEASE);
+            return;
+        }
+        else
+        {
+            position = __atomic_load_n(&enqueue_position, __ATOMIC_RELAXED);
+        }
+    }
+    e->level = l;
+    e->time = Elapsed();
+    vsnprintf(e->text, sizeof(e->text), format, args);
+    va_end(args);
+    __atomic_store_n(&e->sequence, position + 1, __ATOMIC_RELEASE);
+    SDL_SemPost(wake);
+    __atomic_sub_fetch(&writers, 1, __ATOMIC_RELEASE);
+}
+
+//Writes the messages still queued and stops the writer thread.
+void DestroyLog()
+{
+    if(!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) return;
+    __atomic_store_n(&running, 0, __ATOMIC_SEQ_CST);
+    //Messages already claimed are published before the last drain.
+    while(__atomic_load_n(&writers, __ATOMIC_SEQ_CST) > 0) SDL_Delay(0);
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    SDL_SemPost(wake);
+    SDL_WaitThread(thread, NULL);
+    SDL_DestroySemaphore(wake);
+    Drain();
+    if(file) fclose(file);
+    file = NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef LOG_H_
+#define LOG_H_
+
+#define LOG_QUEUE 256    //Messages waiting to be written, a power of two
+#define LOG_MESSAGE 1024 //Longest message, longer ones are cut off
+
+typedef enum
+{
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARNING,
+    LOG_ERROR
+} LogLevel;
+
+/*
+ * Leveled logging that never blocks the caller. Messages are formatted
+ * into a lock-free queue and written to stderr, and to a file if one is
+ * open, by a writer thread. When the queue is full, messages are dropped
+ * and counted instead of waiting. Before InitLog, and after DestroyLog,
+ * messages are written to stderr directly.
+ */
+int InitLog();
+void SetLogLevel(LogLevel level);
+int OpenLogFile(const char* path);
+void Log(LogLevel level, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+void DestroyLog();
+
+#endif
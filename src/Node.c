@@ -1,92 +1,74 @@
 #include "Node.h"
-#include <stdlib.h>
 
-void ConstructNode(Node* node)
+void ConstructNode(Node* node, Hierarchy* hierarchy)
 {
-    node->parent = NULL;
-    node->child = NULL;
-    node->sibling = NULL;
-    mat4x4_identity(node->local_matrix);
-    mat4x4_identity(node->world_matrix);
-    quat_identity(node->rotation);
-    quat_identity(node->orientation);
-    int i;
-    for(i = 0; i < 3; i++)
-    {
-        node->translation[i] = 0.f;
-        node->position[i] = 0.f;
-    }
+    node->hierarchy = hierarchy;
+    node->id = AddHierarchyNode(hierarchy);
 }
 
 void AddChildNode(Node* parent, Node* child)
 {
-    if(child->parent) RemoveChildNode(child->parent, child);
-    child->sibling = parent->child;
-    child->parent = parent;
-    parent->child = child;
+    SetHierarchyParent(child->hierarchy, child->id, parent->id);
 }
 
 void RemoveChildNode(Node* parent, Node* child)
 {
-    Node* prev = NULL;
-    Node* node = parent->child;
-    while(node && node != child)
-    {
-        prev = node;
-        node = node->sibling;
-    }
-    if(node)
-    {
-        if(prev)
-        {
-            prev->sibling = child->sibling;
-        }
-        else
-        {
-            parent->child = child->sibling;
-        }
-        child->parent = NULL;
-        child->sibling = NULL;
-    }
+    Hierarchy* h = child->hierarchy;
+    int parent_index = h->parents[h->indices[child->id]];
+    if(parent_index >= 0 && h->ids[parent_index] == parent->id)
+        SetHierarchyParent(h, child->id, -1);
 }
 
 void SetParentNode(Node* node, Node* parent)
 {
-    if(node->parent) RemoveChildNode(node->parent, node);
-    if(parent) AddChildNode(parent, node);
+    SetHierarchyParent(node->hierarchy, node->id, parent ? parent->id : -1);
 }
 
+/*
+ * Brings the world transforms of the node up to date, along with those of
+ * every other node of its hierarchy that changed.
+ */
 void UpdateNode(Node* node)
 {
-    mat4x4_from_quat(node->local_matrix, node->rotation);
-    mat4x4_translate_in_place(node->local_matrix,
-                              node->translation[0],
-                              node->translation[1],
-                              node->translation[2]);
-    if(node->parent)
-    {
-        mat4x4_mul(node->world_matrix,
-                   node->parent->world_matrix,
-                   node->local_matrix);
-        quat_mul(node->orientation,
-                 node->parent->orientation,
-                 node->rotation);
-        vec3 nt;
-        vec3_norm(nt, node->translation);
-        quat_mul_vec3(nt, node->parent->orientation, nt);
-        vec3_scale(nt, nt, vec3_len(node->translation));
-        vec3_add(node->position, node->parent->position, nt);
-    }
-    else
-    {
-        mat4x4_dup(node->world_matrix, node->local_matrix);
-        int i;
-        for(i = 0; i < 4; i++)
-            node->orientation[i] = node->rotation[i];
-        for(i = 0; i < 3; i++)
-            node->position[i] = node->translation[i];
-    }
-    Node* child;
-    for(child = node->child; child != NULL; child = child->sibling)
-        UpdateNode(child);
+    UpdateHierarchy(node->hierarchy);
+}
+
+void SetNodeRotation(Node* node, quat rotation)
+{
+    SetHierarchyRotation(node->hierarchy, node->id, rotation);
+}
+
+void SetNodeTranslation(Node* node, vec3 translation)
+{
+    SetHierarchyTranslation(node->hierarchy, node->id, translation);
+}
+
+float* GetNodeRotation(Node* node)
+{
+    Hierarchy* h = node->hierarchy;
+    return h->rotations[h->indices[node->id]];
+}
+
+float* GetNodeTranslation(Node* node)
+{
+    Hierarchy* h = node->hierarchy;
+    return h->translations[h->indices[node->id]];
+}
+
+vec4* GetNodeWorldMatrix(Node* node)
+{
+    Hierarchy* h = node->hierarchy;
+    return h->world_matrices[h->indices[node->id]];
+}
+
+float* GetNodeOrientation(Node* node)
+{
+    Hierarchy* h = node->hierarchy;
+    return h->orientations[h->indices[node->id]];
+}
+
+float* GetNodePosition(Node* node)
+{
+    Hierarchy* h = node->hierarchy;
+    return h->positions[h->indices[node->id]];
 }
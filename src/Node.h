@@ -2,24 +2,31 @@
 #define NODE_H_
 
 #include <linmath.h>
+#include "Hierarchy.h"
 
-typedef struct _Node
+/*
+ * Handle to a node of a Hierarchy. The transforms are got through the
+ * functions below, as pointers into the hierarchy that stay valid until a
+ * node is added to it or given a parent. They are read only, set the local
+ * transform with SetNodeRotation and SetNodeTranslation.
+ */
+typedef struct
 {
-    struct _Node* parent;
-    struct _Node* child;
-    struct _Node* sibling;
-    mat4x4 local_matrix;
-    mat4x4 world_matrix;
-    quat rotation;
-    quat orientation;
-    vec3 translation;
-    vec3 position;
+    Hierarchy* hierarchy;
+    int id;
 } Node;
 
-void ConstructNode(Node* node);
+void ConstructNode(Node* node, Hierarchy* hierarchy);
 void AddChildNode(Node* parent, Node* child);
 void RemoveChildNode(Node* parent, Node* child);
 void SetParentNode(Node* node, Node* parent);
 void UpdateNode(Node* node);
+void SetNodeRotation(Node* node, quat rotation);
+void SetNodeTranslation(Node* node, vec3 translation);
+float* GetNodeRotation(Node* node);
+float* GetNodeTranslation(Node* node);
+vec4* GetNodeWorldMatrix(Node* node);
+float* GetNodeOrientation(Node* node);
+float* GetNodePosition(Node* node);
 
 #endif
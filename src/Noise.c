@@ -0,0 +1,263 @@
+//https://github.com/hughsk/glsl-noise/blob/master/simplex/2d.glsl
+//Copyright (C) 2011 by Ashima Arts (Simplex noise)
+//Copyright (C) 2011 by Stefan Gustavson (Classic noise)
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//THE SOFTWARE.
+
+#include "Noise.h"
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define HEIGHT_OCTAVES 16
+#define HEIGHT_BOUND_OCTAVES 4 //Strongest octaves evaluated by HeightBounds
+
+//GLSL mod, which unlike fmodf rounds towards negative infinity.
+static float Mod289(float x)
+{
+    return x - floorf(x / 289.f) * 289.f;
+}
+
+static float Permute(float x)
+{
+    return Mod289(((x*34.f)+1.f)*x);
+}
+
+float SimplexNoise(float x, float y)
+{
+    const float C[4] = { 0.211324865405187f, 0.366025403784439f,
+                         -0.577350269189626f, 0.024390243902439f };
+    float ix = floorf(x + (x + y)*C[1]);
+    float iy = floorf(y + (x + y)*C[1]);
+    float x0 = x - ix + (ix + iy)*C[0];
+    float y0 = y - iy + (ix + iy)*C[0];
+    float i1x = x0 > y0 ? 1.f : 0.f;
+    float i1y = 1.f - i1x;
+    float xs[3] = { x0, x0 + C[0] - i1x, x0 + C[2] };
+    float ys[3] = { y0, y0 + C[0] - i1y, y0 + C[2] };
+    ix = Mod289(ix);
+    iy = Mod289(iy);
+    float p[3];
+    p[0] = Permute(Permute(iy) + ix);
+    p[1] = Permute(Permute(iy + i1y) + ix + i1x);
+    p[2] = Permute(Permute(iy + 1.f) + ix + 1.f);
+    float noise = 0.f;
+    int i;
+    for(i = 0; i < 3; i++)
+    {
+        float m = fmaxf(0.5f - (xs[i]*xs[i] + ys[i]*ys[i]), 0.f);
+        m = m*m;
+        m = m*m;
+        float px = p[i] * C[3];
+        float gx = 2.f * (px - floorf(px)) - 1.f;
+        float h = fabsf(gx) - 0.5f;
+        float a0 = gx - floorf(gx + 0.5f);
+        m *= 1.79284291400159f - 0.85373472095314f * (a0*a0 + h*h);
+        noise += m * (a0*xs[i] + h*ys[i]);
+    }
+    return 130.f * noise;
+}
+
+#ifdef __SSE2__
+//floorf for values within the range of int.
+static __m128 Floor4(__m128 x)
+{
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.f)));
+}
+
+static __m128 Mod289x4(__m128 x)
+{
+    const __m128 d = _mm_set1_ps(289.f);
+    return _mm_sub_ps(x, _mm_mul_ps(Floor4(_mm_div_ps(x, d)), d));
+}
+
+static __m128 Permute4(__m128 x)
+{
+    __m128 t = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(34.f)), _mm_set1_ps(1.f));
+    return Mod289x4(_mm_mul_ps(t, x));
+}
+
+/*
+ * SimplexNoise at four points at once. The operations are the same as in
+ * the scalar version and in the same order, so the results are identical.
+ */
+static __m128 SimplexNoise4(__m128 x, __m128 y)
+{
+    const __m128 c0 = _mm_set1_ps(0.211324865405187f);
+    const __m128 c1 = _mm_set1_ps(0.366025403784439f);
+    const __m128 c2 = _mm_set1_ps(-0.577350269189626f);
+    const __m128 c3 = _mm_set1_ps(0.024390243902439f);
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 sign = _mm_set1_ps(-0.f);
+    __m128 s = _mm_mul_ps(_mm_add_ps(x, y), c1);
+    __m128 ix = Floor4(_mm_add_ps(x, s));
+    __m128 iy = Floor4(_mm_add_ps(y, s));
+    __m128 t = _mm_mul_ps(_mm_add_ps(ix, iy), c0);
+    __m128 x0 = _mm_add_ps(_mm_sub_ps(x, ix), t);
+    __m128 y0 = _mm_add_ps(_mm_sub_ps(y, iy), t);
+    __m128 i1x = _mm_and_ps(_mm_cmpgt_ps(x0, y0), one);
+    __m128 i1y = _mm_sub_ps(one, i1x);
+    __m128 xs[3], ys[3], p[3];
+    xs[0] = x0;
+    xs[1] = _mm_sub_ps(_mm_add_ps(x0, c0), i1x);
+    xs[2] = _mm_add_ps(x0, c2);
+    ys[0] = y0;
+    ys[1] = _mm_sub_ps(_mm_add_ps(y0, c0), i1y);
+    ys[2] = _mm_add_ps(y0, c2);
+    ix = Mod289x4(ix);
+    iy = Mod289x4(iy);
+    p[0] = Permute4(_mm_add_ps(Permute4(iy), ix));
+    p[1] = Permute4(_mm_add_ps(_mm_add_ps(Permute4(_mm_add_ps(iy, i1y)), ix),
+                               i1x));
+    p[2] = Permute4(_mm_add_ps(_mm_add_ps(Permute4(_mm_add_ps(iy, one)), ix),
+                               one));
+    __m128 noise = _mm_setzero_ps();
+    int i;
+    for(i = 0; i < 3; i++)
+    {
+        __m128 m = _mm_sub_ps(half, _mm_add_ps(_mm_mul_ps(xs[i], xs[i]),
+                                               _mm_mul_ps(ys[i], ys[i])));
+        m = _mm_max_ps(m, _mm_setzero_ps());
+        m = _mm_mul_ps(m, m);
+        m = _mm_mul_ps(m, m);
+        __m128 px = _mm_mul_ps(p[i], c3);
+        __m128 gx = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.f),
+                                          _mm_sub_ps(px, Floor4(px))), one);
+        __m128 h = _mm_sub_ps(_mm_andnot_ps(sign, gx), half);
+        __m128 a0 = _mm_sub_ps(gx, Floor4(_mm_add_ps(gx, half)));
+        __m128 r = _mm_add_ps(_mm_mul_ps(a0, a0), _mm_mul_ps(h, h));
+        m = _mm_mul_ps(m, _mm_sub_ps(_mm_set1_ps(1.79284291400159f),
+                                     _mm_mul_ps(_mm_set1_ps(0.85373472095314f),
+                                                r)));
+        noise = _mm_add_ps(noise,
+                           _mm_mul_ps(m, _mm_add_ps(_mm_mul_ps(a0, xs[i]),
+                                                    _mm_mul_ps(h, ys[i]))));
+    }
+    return _mm_mul_ps(_mm_set1_ps(130.f), noise);
+}
+#endif
+
+//Noise at the four points (x[i], y[i]), with SSE2 where available.
+void Noise4(unsigned int l, const float* x, const float* y, float p, float f,
+            float min, float max, float* out)
+{
+    int i;
+#ifdef __SSE2__
+    __m128 px = _mm_loadu_ps(x), py = _mm_loadu_ps(y);
+    __m128 noise = _mm_setzero_ps();
+    float maxAmp = 0.f;
+    float amp = 1.f;
+    unsigned int j;
+    for(j = 0; j < l; j++)
+    {
+        __m128 vf = _mm_set1_ps(f);
+        __m128 n = SimplexNoise4(_mm_mul_ps(px, vf), _mm_mul_ps(py, vf));
+        noise = _mm_add_ps(noise, _mm_mul_ps(n, _mm_set1_ps(amp)));
+        maxAmp += amp;
+        amp *= p;
+        f *= 2.f;
+    }
+    _mm_storeu_ps(out, _mm_div_ps(noise, _mm_set1_ps(maxAmp)));
+    for(i = 0; i < 4; i++)
+        out[i] = out[i] * (max - min) / 2.f + (max + min) / 2.f;
+#else
+    for(i = 0; i < 4; i++) out[i] = Noise(l, x[i], y[i], p, f, min, max);
+#endif
+}
+
+float Noise(unsigned int l, float x, float y, float p, float f, float min,
+            float max)
+{
+    float maxAmp = 0.f;
+    float amp = 1.f;
+    float noise = 0.f;
+    unsigned int i;
+    for(i = 0; i < l; i++)
+    {
+        noise += SimplexNoise(x*f, y*f)*amp;
+        maxAmp += amp;
+        amp *= p;
+        f *= 2.f;
+    }
+    noise /= maxAmp;
+    noise = noise * (max - min) / 2.f + (max + min) / 2.f;
+    return noise;
+}
+
+float Height(float x, float z)
+{
+    return Noise(HEIGHT_OCTAVES, x*0.0005f, z*0.0005f, 5.f, 0.001f, 0.f,
+                 20.f);
+}
+
+void Height4(const float* x, const float* z, float* out)
+{
+    float nx[4], nz[4];
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        nx[i] = x[i]*0.0005f;
+        nz[i] = z[i]*0.0005f;
+    }
+    Noise4(HEIGHT_OCTAVES, nx, nz, 5.f, 0.001f, 0.f, 20.f, out);
+}
+
+/*
+ * Bounds Height over the n by n grid points spaced one unit apart starting
+ * at (x, z). The amplitude grows with each octave, so only the strongest
+ * are evaluated and the others are bounded by their amplitude, as simplex
+ * noise stays within [-1, 1]. Costs a quarter of evaluating every point.
+ */
+void HeightBounds(float x, float z, int n, float* min, float* max)
+{
+    float amps[HEIGHT_OCTAVES], freqs[HEIGHT_OCTAVES];
+    float maxAmp = 0.f, rest = 0.f;
+    float amp = 1.f, f = 0.001f;
+    int first = HEIGHT_OCTAVES - HEIGHT_BOUND_OCTAVES;
+    int i, j, k;
+    for(k = 0; k < HEIGHT_OCTAVES; k++)
+    {
+        amps[k] = amp;
+        freqs[k] = f * 0.0005f;
+        maxAmp += amp;
+        if(k < first) rest += amp;
+        amp *= 5.f;
+        f *= 2.f;
+    }
+    float lo = INFINITY, hi = -INFINITY;
+    for(i = 0; i < n; i++)
+    {
+        for(j = 0; j < n; j++)
+        {
+            float noise = 0.f;
+            for(k = first; k < HEIGHT_OCTAVES; k++)
+                noise += SimplexNoise((x + i)*freqs[k],
+                                      (z + j)*freqs[k])*amps[k];
+            lo = fminf(lo, noise);
+            hi = fmaxf(hi, noise);
+        }
+    }
+    //1% slack on the rest covers the rounding of the sums.
+    rest *= 1.01f;
+    *min = (lo - rest) / maxAmp * 10.f + 10.f;
+    *max = (hi + rest) / maxAmp * 10.f + 10.f;
+}
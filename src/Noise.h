@@ -0,0 +1,18 @@
+#ifndef NOISE_H_
+#define NOISE_H_
+
+/*
+ * CPU versions of the functions in Noise.glsl. They follow the shader
+ * operation for operation, so heights agree with the rendered terrain up to
+ * rounding.
+ */
+float SimplexNoise(float x, float y);
+float Noise(unsigned int l, float x, float y, float p, float f, float min,
+            float max);
+void Noise4(unsigned int l, const float* x, const float* y, float p, float f,
+            float min, float max, float* out);
+float Height(float x, float z);
+void Height4(const float* x, const float* z, float* out);
+void HeightBounds(float x, float z, int n, float* min, float* max);
+
+#endif
@@ -0,0 +1,243 @@
+#include "Occlusion.h"
+#include "Shaders.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const GLfloat CUBE_CORNERS[] =
+{
+    0.f, 0.f, 0.f,  1.f, 0.f, 0.f,  0.f, 1.f, 0.f,  1.f, 1.f, 0.f,
+    0.f, 0.f, 1.f,  1.f, 0.f, 1.f,  0.f, 1.f, 1.f,  1.f, 1.f, 1.f
+};
+
+static const GLubyte CUBE_INDICES[] =
+{
+    0, 1, 2,  2, 1, 3,  4, 6, 5,  5, 6, 7,
+    0, 2, 4,  4, 2, 6,  1, 5, 3,  3, 5, 7,
+    0, 4, 1,  1, 4, 5,  2, 3, 6,  6, 3, 7
+};
+
+static void ResetTiles(Occlusion* occlusion)
+{
+    int i;
+    for(i = 0; i < occlusion->width*occlusion->width; i++)
+    {
+        OcclusionTile* tile = occlusion->tiles + i;
+        if(tile->query) glDeleteQueries(1, &tile->query);
+        tile->query = 0;
+        tile->valid = 0;
+    }
+}
+
+/*
+ * Sets up the bounding boxes and starts building their program, see
+ * FinishOcclusion. Tiles known to be visible are only tested again every
+ * interval frames.
+ */
+void ConstructOcclusion(Occlusion* occlusion, unsigned int interval)
+{
+    const ShaderSource source = {
+        GL_VERTEX_SHADER, "BoundsVertex.glsl", NULL
+    };
+    StartProgram(&occlusion->build, 1, &source, 0, NULL);
+    occlusion->program = 0;
+
+    glGenVertexArrays(1, &occlusion->vao);
+    glBindVertexArray(occlusion->vao);
+    glGenBuffers(1, &occlusion->vbuf);
+    glBindBuffer(GL_ARRAY_BUFFER, occlusion->vbuf);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(CUBE_CORNERS), CUBE_CORNERS,
+                 GL_STATIC_DRAW);
+    glGenBuffers(1, &occlusion->ibuf);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, occlusion->ibuf);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(CUBE_INDICES), CUBE_INDICES,
+                 GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    occlusion->target = GLAD_GL_VERSION_3_3 ? GL_ANY_SAMPLES_PASSED :
+                                              GL_SAMPLES_PASSED;
+    occlusion->interval = interval;
+    occlusion->frame = 0;
+    occlusion->tiles = NULL;
+    occlusion->width = 0;
+    occlusion->tests = NULL;
+    occlusion->test_count = 0;
+    occlusion->occluded = 0;
+    mat4x4_identity(occlusion->view_projection);
+    occlusion->moved = 0;
+    occlusion->unsettled = 0;
+}
+
+//Waits for the bounding box program. Returns a negative value if it failed.
+int FinishOcclusion(Occlusion* occlusion)
+{
+    if(FinishProgram(&occlusion->build, &occlusion->program) < 0) return -1;
+    GLuint program = occlusion->program;
+    occlusion->min_loc = glGetUniformLocation(program, "bounds_min");
+    occlusion->max_loc = glGetUniformLocation(program, "bounds_max");
+    occlusion->view_projection_loc = glGetUniformLocation(program,
+                                                          "view_projection");
+    glBindVertexArray(occlusion->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, occlusion->vbuf);
+    GLint corner_loc = glGetAttribLocation(program, "corner");
+    glEnableVertexAttribArray(corner_loc);
+    glVertexAttribPointer(corner_loc, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindVertexArray(0);
+    return 0;
+}
+
+/*
+ * Starts a frame. The table is sized to hold every tile within radius of
+ * the camera tile.
+ */
+void BeginOcclusionFrame(Occlusion* occlusion, int radius,
+                         mat4x4 view_projection)
+{
+    occlusion->frame++;
+    occlusion->test_count = 0;
+    occlusion->occluded = 0;
+    occlusion->unsettled = 0;
+    if(memcmp(occlusion->view_projection, view_projection,
+              sizeof(mat4x4)) != 0)
+    {
+        mat4x4_dup(occlusion->view_projection, view_projection);
+        occlusion->moved = occlusion->frame;
+    }
+    int width = 2*radius+1;
+    if(width == occlusion->width) return;
+    ResetTiles(occlusion);
+    occlusion->width = width;
+    occlusion->tiles = realloc(occlusion->tiles,
+                               width*width*sizeof(OcclusionTile));
+    occlusion->tests = realloc(occlusion->tests, width*width*sizeof(int));
+    int i;
+    for(i = 0; i < width*width; i++)
+    {
+        occlusion->tiles[i].query = 0;
+        occlusion->tiles[i].valid = 0;
+    }
+}
+
+static int Wrap(int a, int n)
+{
+    a %= n;
+    return a < 0 ? a + n : a;
+}
+
+/*
+ * Called for each tile in the frustum, nearest first. Returns the query to
+ * draw the tile under with conditional rendering, or 0 to draw it
+ * unconditionally, and decides whether its bounding box is tested after
+ * the terrain has been drawn. Results are only read once available, so the
+ * CPU never waits for the GPU.
+ */
+GLuint OcclusionCondition(Occlusion* occlusion, int x, int z, vec3 min,
+                          vec3 max, vec3 position)
+{
+    int slot = Wrap(x, occlusion->width)*occlusion->width +
+               Wrap(z, occlusion->width);
+    OcclusionTile* tile = occlusion->tiles + slot;
+    int i;
+    if(!tile->valid || tile->x != x || tile->z != z ||
+       tile->seen != occlusion->frame - 1)
+    {
+        //New in view, so nothing is known about it.
+        if(!tile->query) glGenQueries(1, &tile->query);
+        tile->x = x;
+        tile->z = z;
+        tile->valid = 1;
+        tile->issued = 0;
+        tile->pending = 0;
+        tile->visible = 1;
+        tile->tested = occlusion->frame - occlusion->interval;
+    }
+    tile->seen = occlusion->frame;
+    for(i = 0; i < 3; i++)
+    {
+        tile->min[i] = min[i];
+        tile->max[i] = max[i];
+    }
+
+    if(tile->pending)
+    {
+        GLuint available = 0;
+        glGetQueryObjectuiv(tile->query, GL_QUERY_RESULT_AVAILABLE,
+                            &available);
+        if(available)
+        {
+            GLuint passed = 0;
+            glGetQueryObjectuiv(tile->query, GL_QUERY_RESULT, &passed);
+            tile->visible = passed != 0;
+            tile->pending = 0;
+        }
+    }
+
+    int inside = position[0] >= min[0] && position[0] <= max[0] &&
+                 position[1] >= min[1] && position[1] <= max[1] &&
+                 position[2] >= min[2] && position[2] <= max[2];
+    if(inside)
+    {
+        tile->visible = 1;
+        tile->tested = occlusion->frame;
+        return 0;
+    }
+    if(!tile->pending &&
+       (!tile->visible ||
+        occlusion->frame - tile->tested >= occlusion->interval))
+    {
+        occlusion->tests[occlusion->test_count++] = slot;
+    }
+    if(tile->visible && !tile->pending) return 0;
+    if(!tile->visible) occlusion->occluded++;
+    if(!tile->issued) return 0;
+    //The draw rests on the last test, which may predate the current view.
+    if(tile->tested < occlusion->moved) occlusion->unsettled++;
+    return tile->query;
+}
+
+/*
+ * Draws the bounding boxes of the tiles selected for testing against the
+ * depth buffer of the frame, without writing color or depth.
+ */
+void TestOcclusion(Occlusion* occlusion, RenderState* state,
+                   mat4x4 view_projection)
+{
+    if(occlusion->test_count == 0) return;
+    UseProgram(state, occlusion->program);
+    SetUniform(state, occlusion->program, UNIFORM_MAT4,
+               occlusion->view_projection_loc, view_projection);
+    BindVertexArray(state, occlusion->vao);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+    int i;
+    for(i = 0; i < occlusion->test_count; i++)
+    {
+        OcclusionTile* tile = occlusion->tiles + occlusion->tests[i];
+        SetUniform(state, occlusion->program, UNIFORM_VEC3,
+                   occlusion->min_loc, tile->min);
+        SetUniform(state, occlusion->program, UNIFORM_VEC3,
+                   occlusion->max_loc, tile->max);
+        glBeginQuery(occlusion->target, tile->query);
+        glDrawElements(GL_TRIANGLES, sizeof(CUBE_INDICES), GL_UNSIGNED_BYTE,
+                       NULL);
+        glEndQuery(occlusion->target);
+        tile->issued = 1;
+        tile->pending = 1;
+        tile->tested = occlusion->frame;
+    }
+    glEnable(GL_CULL_FACE);
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void DestroyOcclusion(Occlusion* occlusion)
+{
+    FinishProgram(&occlusion->build, NULL);
+    ResetTiles(occlusion);
+    free(occlusion->tiles);
+    free(occlusion->tests);
+    glDeleteBuffers(1, &occlusion->vbuf);
+    glDeleteBuffers(1, &occlusion->ibuf);
+    glDeleteVertexArrays(1, &occlusion->vao);
+    glDeleteProgram(occlusion->program);
+}
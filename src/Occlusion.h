@@ -0,0 +1,51 @@
+#ifndef OCCLUSION_H_
+#define OCCLUSION_H_
+
+#include <glad/glad.h>
+#include <linmath.h>
+#include "Render.h"
+#include "Shaders.h"
+
+/*
+ * Occlusion state of one tile, kept across frames in a table that wraps
+ * around in both directions so tiles keep their slot while the camera
+ * moves.
+ */
+typedef struct
+{
+    int x, z;
+    vec3 min, max;
+    GLuint query;
+    unsigned int seen, tested;
+    char valid, issued, pending, visible;
+} OcclusionTile;
+
+typedef struct
+{
+    OcclusionTile* tiles;
+    int width;
+    unsigned int frame;
+    unsigned int interval;
+    GLenum target;
+    GLuint program, vao, vbuf, ibuf;
+    GLint min_loc, max_loc, view_projection_loc;
+    ProgramBuild build; //Until FinishOcclusion
+    int* tests;
+    int test_count;
+    int occluded;
+    mat4x4 view_projection;
+    unsigned int moved;  //Last frame the view changed
+    int unsettled;       //Tiles drawn on results from an older view
+} Occlusion;
+
+void ConstructOcclusion(Occlusion* occlusion, unsigned int interval);
+int FinishOcclusion(Occlusion* occlusion);
+void BeginOcclusionFrame(Occlusion* occlusion, int radius,
+                         mat4x4 view_projection);
+GLuint OcclusionCondition(Occlusion* occlusion, int x, int z, vec3 min,
+                          vec3 max, vec3 position);
+void TestOcclusion(Occlusion* occlusion, RenderState* state,
+                   mat4x4 view_projection);
+void DestroyOcclusion(Occlusion* occlusion);
+
+#endif
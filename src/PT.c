@@ -1,35 +1,81 @@
 #include <SDL2/SDL.h>
 #include "PT.h"
+#include <stdio.h>
 
 SDL_Window* window;
 SDL_GLContext context;
+static Headless headless;
+static char dialogs = 1; //Whether fatal errors are shown in a message box
 
 void Quit()
 {
-    SDL_GL_DeleteContext(context);
-    SDL_DestroyWindow(window);
+    if(window)
+    {
+        SDL_GL_DeleteContext(context);
+        SDL_DestroyWindow(window);
+    }
+    else
+    {
+        DestroyHeadless(&headless);
+    }
     SDL_Quit();
 }
 
+/*
+ * Sets up SDL without video and draws into an offscreen framebuffer, for
+ * machines without a display. window stays NULL.
+ */
+static int InitHeadless(Settings* settings)
+{
+    //There may be no display to show message boxes on.
+    dialogs = 0;
+    int phase = BeginStartupPhase("SDL_Init");
+    if(SDL_Init(SDL_INIT_EVENTS | SDL_INIT_TIMER) < 0)
+    {
+        Message("Error: Could not initialize SDL.", SDL_GetError());
+        return -1;
+    }
+    EndStartupPhase(phase);
+    phase = BeginStartupPhase("ConstructHeadless");
+    int err = ConstructHeadless(&headless, settings->video.width,
+                                settings->video.height);
+    EndStartupPhase(phase);
+    if(err < 0)
+    {
+        Message("Error: Could not create GL context.",
+                "Unable to create an offscreen OpenGL context with EGL.");
+        SDL_Quit();
+        return -4;
+    }
+    window = NULL;
+    atexit(Quit);
+    return 0;
+}
+
 int Init(Settings* settings)
 {
+    if(settings->video.headless) return InitHeadless(settings);
+
+    int phase = BeginStartupPhase("SDL_Init");
     if(SDL_Init(SDL_INIT_VIDEO) < 0)
     {
         Message("Error: Could not initialize SDL.", SDL_GetError());
         return -1;
     }
+    EndStartupPhase(phase);
 
+    phase = BeginStartupPhase("SDL_GL_LoadLibrary");
     if(SDL_GL_LoadLibrary(NULL) < 0)
     {
         Message("Error: Could not load GL library.", SDL_GetError());
         SDL_Quit();
         return -2;
     }
+    EndStartupPhase(phase);
 
     SDL_GL_SetAttribute(SDL_GL_ACCELERATED_VISUAL, 1);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
 
+    phase = BeginStartupPhase("SDL_CreateWindow");
     window = SDL_CreateWindow
     (
         "PTGame",
@@ -45,9 +91,23 @@ int Init(Settings* settings)
         SDL_Quit();
         return -3;
     }
+    EndStartupPhase(phase);
 
+    //Prefer 4.3 for the indirect drawing paths, but still run on 3.1.
+    phase = BeginStartupPhase("SDL_GL_CreateContext");
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
+                        SDL_GL_CONTEXT_PROFILE_CORE);
     context = SDL_GL_CreateContext(window);
     if(!context)
+    {
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, 0);
+        context = SDL_GL_CreateContext(window);
+    }
+    if(!context)
     {
         Message("Error: Could not create GL context.", SDL_GetError());
         SDL_DestroyWindow(window);
@@ -55,13 +115,14 @@ int Init(Settings* settings)
         return -4;
     }
 
-    if(settings->video.vsync &&
-       SDL_GL_SetSwapInterval(-1) < 0 &&
-       SDL_GL_SetSwapInterval(1) < 0)
+    EndStartupPhase(phase);
+
+    if(settings->video.vsync && SetVSync(1) < 0)
     {
-        Message("Warning: VSync not supported.", SDL_GetError());
+        Log(LOG_WARNING, "VSync not supported: %s", SDL_GetError());
     }
 
+    phase = BeginStartupPhase("gladLoadGLLoader");
     if(!gladLoadGLLoader(SDL_GL_GetProcAddress))
     {
         Message("Error: Could not load GL extensions.",
@@ -69,17 +130,92 @@ int Init(Settings* settings)
         Quit();
         return -5;
     }
+    EndStartupPhase(phase);
 
     atexit(Quit);
     return 0;
 }
 
 
+//Turns vsync off or on, adaptive where supported. Returns -1 on failure.
+int SetVSync(char vsync)
+{
+    if(!vsync) return SDL_GL_SetSwapInterval(0) < 0 ? -1 : 0;
+    if(SDL_GL_SetSwapInterval(-1) < 0 && SDL_GL_SetSwapInterval(1) < 0)
+        return -1;
+    return 0;
+}
+
+/*
+ * Creates a second GL context sharing objects with the main one, for a
+ * background thread to make current with MakeWorkerContextCurrent. The
+ * main context stays current on the calling thread. Returns NULL on
+ * failure.
+ */
+void* CreateWorkerContext()
+{
+    if(!window) return CreateHeadlessWorker(&headless);
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+    SDL_GLContext worker = SDL_GL_CreateContext(window);
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+    SDL_GL_MakeCurrent(window, context);
+    return worker;
+}
+
+/*
+ * Makes a worker context current on the calling thread, or none if NULL.
+ * Worker contexts never draw, so they are made current without the window
+ * where the platform allows it, leaving the window to the main thread.
+ */
+int MakeWorkerContextCurrent(void* worker)
+{
+    if(!window) return MakeHeadlessWorkerCurrent(&headless, worker);
+    if(SDL_GL_MakeCurrent(NULL, worker) == 0) return 0;
+    return SDL_GL_MakeCurrent(window, worker);
+}
+
+void DestroyWorkerContext(void* worker)
+{
+    if(!window) DestroyHeadlessWorker(&headless, worker);
+    else SDL_GL_DeleteContext(worker);
+}
+
+//Presents the frame, or finishes it when headless.
+void SwapFrame()
+{
+    if(window) SDL_GL_SwapWindow(window);
+    else FinishHeadlessFrame(&headless);
+}
+
+//Gets the size of the framebuffer frames are drawn into.
+void GetFrameSize(int* width, int* height)
+{
+    if(window)
+    {
+        SDL_GL_GetDrawableSize(window, width, height);
+    }
+    else
+    {
+        *width = headless.width;
+        *height = headless.height;
+    }
+}
+
+/*
+ * Reports a fatal error. It is logged, and shown in a message box unless
+ * running headless, which blocks until dismissed. Use Log for anything
+ * the game carries on after.
+ */
 void Message(const char* title, const char* msg)
 {
+    Log(LOG_ERROR, "%s %s", title, msg);
+    if(!dialogs) return;
+    //Wait for the message to be written, in case the box can't be shown or
+    //the game exits right after.
+    DestroyLog();
     SDL_ShowSimpleMessageBox
     (
-        SDL_MESSAGEBOX_INFORMATION |
+        SDL_MESSAGEBOX_ERROR |
         SDL_MESSAGEBOX_BUTTON_RETURNKEY_DEFAULT,
         title,
         msg,
@@ -8,12 +8,34 @@
 #include "Node.h"
 #include "Camera.h"
 #include "Settings.h"
+#include "Render.h"
+#include "Frustum.h"
+#include "Occlusion.h"
+#include "Terrain.h"
+#include "Impostor.h"
+#include "Capture.h"
+#include "Headless.h"
+#include "GpuProfiler.h"
+#include "Benchmark.h"
+#include "Profiler.h"
+#include "Governor.h"
+#include "Hud.h"
+#include "Log.h"
+#include "Startup.h"
+#include "Watcher.h"
+#include "ShaderReloader.h"
 #include "Util.h"
 
 extern SDL_Window* window;
 extern SDL_GLContext context;
 
 int Init(Settings* settings);
+int SetVSync(char vsync);
+void* CreateWorkerContext();
+int MakeWorkerContextCurrent(void* worker);
+void DestroyWorkerContext(void* worker);
+void SwapFrame();
+void GetFrameSize(int* width, int* height);
 
 void Message(const char* title, const char* msg);
 
@@ -0,0 +1,160 @@
+#include "Profiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct
+{
+    const char* name;
+    uint64_t start, end;
+    double value;
+    char counter;
+} ProfileEvent;
+
+/*
+ * Events of one thread. Only the owning thread writes, and publishes each
+ * event by advancing head, so a dump sees whole events. The oldest events
+ * are overwritten when the ring is full.
+ */
+typedef struct ProfileRing
+{
+    ProfileEvent events[PROFILE_RING];
+    uint64_t head;
+    int thread;
+    const char* thread_name;
+    struct ProfileRing* next;
+} ProfileRing;
+
+static ProfileRing* rings;
+static int thread_count;
+static __thread ProfileRing* ring;
+static uint64_t base_ticks;
+static struct timespec base_time;
+
+//Starts the clock the trace timestamps are relative to.
+void InitProfiler()
+{
+    clock_gettime(CLOCK_MONOTONIC, &base_time);
+    base_ticks = ProfileTime();
+}
+
+//Gets the calling thread's ring, creating it on the thread's first event.
+static ProfileRing* GetRing()
+{
+    if(ring) return ring;
+    ring = calloc(1, sizeof(ProfileRing));
+    if(!ring) return NULL;
+    ring->thread = __atomic_add_fetch(&thread_count, 1, __ATOMIC_RELAXED);
+    ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&rings, &ring->next, ring, 1,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return ring;
+}
+
+//Names the calling thread in the trace.
+void SetProfileThreadName(const char* name)
+{
+    ProfileRing* r = GetRing();
+    if(r) r->thread_name = name;
+}
+
+static void Record(const char* name, uint64_t start, uint64_t end,
+                   double value, char counter)
+{
+    ProfileRing* r = GetRing();
+    if(!r) return;
+    ProfileEvent* event = &r->events[r->head & (PROFILE_RING - 1)];
+    event->name = name;
+    event->start = start;
+    event->end = end;
+    event->value = value;
+    event->counter = counter;
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+void EndProfileScope(ProfileScope* scope)
+{
+    Record(scope->name, scope->start, ProfileTime(), 0., 0);
+}
+
+//Records the value of a counter, shown as a graph over time in the trace.
+void ProfileCounter(const char* name, double value)
+{
+    uint64_t now = ProfileTime();
+    Record(name, now, now, value, 1);
+}
+
+/*
+ * Writes the events recorded so far as Chrome trace JSON. Events being
+ * overwritten by a running thread during the dump may come out garbled.
+ * Returns -1 if the file can't be written.
+ */
+int DumpProfile(const char* path)
+{
+    FILE* f = fopen(path, "w");
+    if(!f) return -1;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ticks = ProfileTime();
+    double elapsed = (now.tv_sec - base_time.tv_sec)*1e6 +
+                     (now.tv_nsec - base_time.tv_nsec)*1e-3;
+    double us_per_tick = ticks > base_ticks ?
+                         elapsed / (double)(ticks - base_ticks) : 0.;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    char first = 1;
+    ProfileRing* r;
+    for(r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next)
+    {
+        if(r->thread_name)
+        {
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                       "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", r->thread, r->thread_name);
+            first = 0;
+        }
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        uint64_t i = head > PROFILE_RING ? head - PROFILE_RING : 0;
+        for(; i < head; i++)
+        {
+            ProfileEvent* e = &r->events[i & (PROFILE_RING - 1)];
+            if(e->start < base_ticks) continue;
+            if(e->counter)
+            {
+                fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,"
+                           "\"tid\":%d,\"ts\":%.3f,"
+                           "\"args\":{\"value\":%.3f}}",
+                        first ? "" : ",\n", e->name, r->thread,
+                        (e->start - base_ticks)*us_per_tick, e->value);
+                first = 0;
+                continue;
+            }
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                       "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",\n", e->name, r->thread,
+                    (e->start - base_ticks)*us_per_tick,
+                    (e->end - e->start)*us_per_tick);
+            first = 0;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return 0;
+}
+
+/*
+ * Frees the rings of every thread. Only call once the other threads that
+ * recorded events have ended.
+ */
+void DestroyProfiler()
+{
+    ProfileRing* r = rings;
+    while(r)
+    {
+        ProfileRing* next = r->next;
+        free(r);
+        r = next;
+    }
+    rings = NULL;
+    ring = NULL;
+}
@@ -0,0 +1,57 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdint.h>
+
+#define PROFILE_RING 65536 //Events kept per thread, must be a power of two
+
+/*
+ * Scoped CPU timing. PROFILE_SCOPE("name") times the rest of the enclosing
+ * block and records it to a ring of events owned by the calling thread, so
+ * recording takes no locks. DumpProfile writes the recorded events of every
+ * thread as Chrome trace events, for chrome://tracing or Perfetto. Meant
+ * for phases and tasks, not for inner loops. ProfileCounter records values
+ * such as GPU times, graphed alongside the scopes.
+ */
+typedef struct
+{
+    const char* name;
+    uint64_t start;
+} ProfileScope;
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) \
+    ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__) \
+    __attribute__((cleanup(EndProfileScope))) = BeginProfileScope(name)
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t ProfileTime()
+{
+    return __rdtsc();
+}
+#else
+#include <time.h>
+static inline uint64_t ProfileTime()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1000000000ull + t.tv_nsec;
+}
+#endif
+
+static inline ProfileScope BeginProfileScope(const char* name)
+{
+    ProfileScope scope = { name, ProfileTime() };
+    return scope;
+}
+
+void InitProfiler();
+void SetProfileThreadName(const char* name);
+void EndProfileScope(ProfileScope* scope);
+void ProfileCounter(const char* name, double value);
+int DumpProfile(const char* path);
+void DestroyProfiler();
+
+#endif
@@ -0,0 +1,276 @@
+#include "Render.h"
+#include "Log.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const int UNIFORM_SIZE[] =
+{
+    [UNIFORM_INT] = sizeof(GLint),
+    [UNIFORM_FLOAT] = sizeof(GLfloat),
+    [UNIFORM_VEC3] = 3*sizeof(GLfloat),
+    [UNIFORM_MAT4] = 16*sizeof(GLfloat)
+};
+
+void ConstructRenderQueue(RenderQueue* queue)
+{
+    queue->commands = NULL;
+    queue->count = 0;
+    queue->capacity = 0;
+    queue->uniforms = NULL;
+    queue->uniform_count = 0;
+    queue->uniform_capacity = 0;
+}
+
+void ClearRenderQueue(RenderQueue* queue)
+{
+    queue->count = 0;
+    queue->uniform_count = 0;
+}
+
+static uint64_t RenderKey(GLuint program, GLuint vao, float depth)
+{
+    //Non-negative floats compare the same as their bit patterns.
+    uint32_t depth_bits;
+    if(depth < 0.f) depth = 0.f;
+    memcpy(&depth_bits, &depth, sizeof(depth_bits));
+    return (uint64_t)(program & 0xFFFF) << 48 |
+           (uint64_t)(vao & 0xFFFF) << 32 |
+           depth_bits;
+}
+
+/*
+ * Records an indexed draw with default parameters (one instance of an
+ * unsigned int triangle strip). The caller fills in the rest of the returned
+ * command, which stays valid until the next push. Returns NULL if the queue
+ * can't grow.
+ */
+RenderCommand* PushRenderCommand(RenderQueue* queue, GLuint program,
+                                 GLuint vao, float depth)
+{
+    if(queue->count == queue->capacity)
+    {
+        int capacity = queue->capacity ? queue->capacity*2 : 64;
+        RenderCommand* commands = realloc(queue->commands,
+                                          capacity*sizeof(RenderCommand));
+        if(!commands)
+        {
+            Log(LOG_ERROR, "Memory allocation error.");
+            return NULL;
+        }
+        queue->commands = commands;
+        queue->capacity = capacity;
+    }
+    RenderCommand* command = queue->commands + queue->count++;
+    command->key = RenderKey(program, vao, depth);
+    command->program = program;
+    command->vao = vao;
+    command->mode = GL_TRIANGLE_STRIP;
+    command->type = GL_UNSIGNED_INT;
+    command->count = 0;
+    command->instances = 1;
+    command->indices = NULL;
+    command->base_vertex = 0;
+    command->indirect = 0;
+    command->draws = 0;
+    command->condition = 0;
+    command->uniform_first = queue->uniform_count;
+    command->uniform_count = 0;
+    return command;
+}
+
+/*
+ * Adds a uniform value to the most recently pushed command. If the queue
+ * can't grow, that command is dropped, as it would draw with the wrong
+ * uniforms, and a negative value is returned.
+ */
+int PushRenderUniform(RenderQueue* queue, UniformType type, GLint location,
+                      const void* value)
+{
+    RenderCommand* command = queue->commands + queue->count - 1;
+    if(queue->uniform_count == queue->uniform_capacity)
+    {
+        int capacity = queue->uniform_capacity ?
+                       queue->uniform_capacity*2 : 64;
+        Uniform* uniforms = realloc(queue->uniforms,
+                                    capacity*sizeof(Uniform));
+        if(!uniforms)
+        {
+            Log(LOG_ERROR, "Memory allocation error.");
+            queue->uniform_count = command->uniform_first;
+            queue->count--;
+            return -1;
+        }
+        queue->uniforms = uniforms;
+        queue->uniform_capacity = capacity;
+    }
+    Uniform* uniform = queue->uniforms + queue->uniform_count++;
+    uniform->type = type;
+    uniform->location = location;
+    memcpy(&uniform->value, value, UNIFORM_SIZE[type]);
+    command->uniform_count++;
+    return 0;
+}
+
+static int CompareCommands(const void* a, const void* b)
+{
+    uint64_t ka = ((const RenderCommand*)a)->key;
+    uint64_t kb = ((const RenderCommand*)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+void ExecuteRenderQueue(RenderQueue* queue, RenderState* state)
+{
+    qsort(queue->commands, queue->count, sizeof(RenderCommand),
+          CompareCommands);
+    int i, j;
+    for(i = 0; i < queue->count; i++)
+    {
+        RenderCommand* command = queue->commands + i;
+        UseProgram(state, command->program);
+        BindVertexArray(state, command->vao);
+        for(j = 0; j < command->uniform_count; j++)
+        {
+            Uniform* uniform = queue->uniforms + command->uniform_first + j;
+            SetUniform(state, command->program, uniform->type,
+                       uniform->location, &uniform->value);
+        }
+        if(command->condition)
+            glBeginConditionalRender(command->condition, GL_QUERY_NO_WAIT);
+        if(command->indirect)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command->indirect);
+            glMultiDrawElementsIndirect(command->mode, command->type,
+                                        command->indices, command->draws, 0);
+        }
+        else if(command->base_vertex && command->instances == 1)
+        {
+            glDrawElementsBaseVertex(command->mode, command->count,
+                                     command->type, command->indices,
+                                     command->base_vertex);
+        }
+        else if(command->base_vertex)
+        {
+            glDrawElementsInstancedBaseVertex(command->mode, command->count,
+                                              command->type,
+                                              command->indices,
+                                              command->instances,
+                                              command->base_vertex);
+        }
+        else if(command->instances == 1)
+        {
+            glDrawElements(command->mode, command->count, command->type,
+                           command->indices);
+        }
+        else
+        {
+            glDrawElementsInstanced(command->mode, command->count,
+                                    command->type, command->indices,
+                                    command->instances);
+        }
+        if(command->condition) glEndConditionalRender();
+    }
+}
+
+void DestroyRenderQueue(RenderQueue* queue)
+{
+    free(queue->commands);
+    free(queue->uniforms);
+    ConstructRenderQueue(queue);
+}
+
+void ConstructRenderState(RenderState* state)
+{
+    state->program_count = 0;
+    InvalidateRenderState(state);
+}
+
+/*
+ * Forgets the bound program and vertex array. Call after binding either
+ * outside of the render layer.
+ */
+void InvalidateRenderState(RenderState* state)
+{
+    state->program = 0;
+    state->vao = 0;
+    glUseProgram(0);
+    glBindVertexArray(0);
+}
+
+void UseProgram(RenderState* state, GLuint program)
+{
+    if(state->program == program) return;
+    glUseProgram(program);
+    state->program = program;
+}
+
+void BindVertexArray(RenderState* state, GLuint vao)
+{
+    if(state->vao == vao) return;
+    glBindVertexArray(vao);
+    state->vao = vao;
+}
+
+static int FindProgram(RenderState* state, GLuint program)
+{
+    int i;
+    for(i = 0; i < state->program_count; i++)
+        if(state->programs[i].program == program) return i;
+    if(state->program_count == RENDER_MAX_PROGRAMS) return -1;
+    i = state->program_count++;
+    state->programs[i].program = program;
+    memset(state->programs[i].valid, 0, RENDER_MAX_LOCATIONS);
+    return i;
+}
+
+/*
+ * Drops the shadowed uniforms of a program about to be deleted, so its name
+ * can be reused by a new program.
+ */
+void ForgetProgram(RenderState* state, GLuint program)
+{
+    int i;
+    for(i = 0; i < state->program_count; i++)
+    {
+        if(state->programs[i].program != program) continue;
+        state->programs[i] = state->programs[--state->program_count];
+        break;
+    }
+    if(state->program == program) state->program = 0;
+}
+
+/*
+ * Uploads a uniform unless the program already holds the same value. Binds
+ * the program if needed.
+ */
+void SetUniform(RenderState* state, GLuint program, UniformType type,
+                GLint location, const void* value)
+{
+    if(location < 0) return;
+    int p = FindProgram(state, program);
+    if(p >= 0 && location < RENDER_MAX_LOCATIONS)
+    {
+        Uniform* shadow = state->programs[p].uniforms + location;
+        if(state->programs[p].valid[location] && shadow->type == type &&
+           memcmp(&shadow->value, value, UNIFORM_SIZE[type]) == 0)
+            return;
+        shadow->type = type;
+        memcpy(&shadow->value, value, UNIFORM_SIZE[type]);
+        state->programs[p].valid[location] = 1;
+    }
+    UseProgram(state, program);
+    switch(type)
+    {
+    case UNIFORM_INT:
+        glUniform1i(location, *(const GLint*)value);
+        break;
+    case UNIFORM_FLOAT:
+        glUniform1f(location, *(const GLfloat*)value);
+        break;
+    case UNIFORM_VEC3:
+        glUniform3fv(location, 1, value);
+        break;
+    case UNIFORM_MAT4:
+        glUniformMatrix4fv(location, 1, GL_FALSE, value);
+        break;
+    }
+}
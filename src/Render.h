@@ -0,0 +1,93 @@
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include <glad/glad.h>
+#include <stdint.h>
+
+#define RENDER_MAX_PROGRAMS 8
+#define RENDER_MAX_LOCATIONS 32
+
+typedef enum
+{
+    UNIFORM_INT,
+    UNIFORM_FLOAT,
+    UNIFORM_VEC3,
+    UNIFORM_MAT4
+} UniformType;
+
+typedef struct
+{
+    UniformType type;
+    GLint location;
+    union
+    {
+        GLint i;
+        GLfloat f[16];
+    } value;
+} Uniform;
+
+/*
+ * A recorded draw call. Commands are sorted on key, which orders them by
+ * program, then vertex array, then front to back. If indirect is set, the
+ * draw is a multi-draw-indirect of draws commands from that buffer, with
+ * indices as the offset of the first one. Otherwise base_vertex is added
+ * to every index, in every instance. If condition is set, the draw is
+ * skipped when that occlusion query found no samples.
+ */
+typedef struct
+{
+    uint64_t key;
+    GLuint program, vao;
+    GLenum mode, type;
+    GLsizei count, instances;
+    const void* indices;
+    GLint base_vertex;
+    GLuint indirect;
+    GLsizei draws;
+    GLuint condition;
+    int uniform_first, uniform_count;
+} RenderCommand;
+
+typedef struct
+{
+    RenderCommand* commands;
+    int count, capacity;
+    Uniform* uniforms;
+    int uniform_count, uniform_capacity;
+} RenderQueue;
+
+/*
+ * Shadow of the GL state last set through the render layer, used to drop
+ * redundant program, vertex array and uniform changes.
+ */
+typedef struct
+{
+    GLuint program;
+    GLuint vao;
+    struct
+    {
+        GLuint program;
+        Uniform uniforms[RENDER_MAX_LOCATIONS];
+        char valid[RENDER_MAX_LOCATIONS];
+    } programs[RENDER_MAX_PROGRAMS];
+    int program_count;
+} RenderState;
+
+void ConstructRenderQueue(RenderQueue* queue);
+void ClearRenderQueue(RenderQueue* queue);
+RenderCommand* PushRenderCommand(RenderQueue* queue, GLuint program,
+                                 GLuint vao, float depth);
+int PushRenderUniform(RenderQueue* queue, UniformType type, GLint location,
+                      const void* value);
+void ExecuteRenderQueue(RenderQueue* queue, RenderState* state);
+void DestroyRenderQueue(RenderQueue* queue);
+
+void ConstructRenderState(RenderState* state);
+void InvalidateRenderState(RenderState* state);
+void UseProgram(RenderState* state, GLuint program);
+void BindVertexArray(RenderState* state, GLuint vao);
+void SetUniform(RenderState* state, GLuint program, UniformType type,
+                GLint location, const void* value);
+void ForgetProgram(RenderState* state, GLuint program);
+
+#endif
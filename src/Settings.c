@@ -1,6 +1,9 @@
 #include "Settings.h"
-#include "PT.h"
+#include "Log.h"
+#include "TileGenerator.h"
 #include <ini.h>
+#include <stdio.h>
+#include <string.h>
 
 void ConstructSettings(Settings* settings)
 {
@@ -8,14 +11,36 @@ void ConstructSettings(Settings* settings)
     settings->video.width = 640;
     settings->video.height = 480;
     settings->video.vsync = 1;
+    settings->video.idle = 1;
+    settings->video.headless = 0;
+    settings->video.hud = 0;
     settings->video.pfov = 1.f;
     settings->video.pnear = 0.01f;
     settings->video.pfar = 1000.f;
     settings->graphics.viewdistance = 100.f;
+    settings->graphics.autoviewdistance = 0;
+    settings->graphics.frametimebudget = 16.7f;
+    settings->graphics.minviewdistance = 25.f;
+    settings->graphics.maxviewdistance = 400.f;
+    settings->graphics.multidraw = 1;
+    settings->graphics.gpuculling = 1;
+    settings->graphics.occlusionculling = 0;
+    settings->graphics.horizonculling = 0;
+    settings->graphics.tilecache = 0;
+    settings->graphics.tilebaking = 0;
+    settings->graphics.tilegenerator = GENERATOR_GPU;
+    settings->graphics.farviewdistance = 0.f;
+    settings->graphics.impostormove = 25.f;
+    settings->graphics.impostorerror = 0.f;
+    settings->graphics.programcache = 1;
     settings->controls.speed1 = 10.f;
     settings->controls.speed2 = 20.f;
     settings->controls.xsensitivity = 0.01f;
     settings->controls.ysensitivity = 0.01f;
+    settings->capture.png = 1;
+    settings->capture.fps = 60;
+    settings->log.level = LOG_INFO;
+    settings->benchmark.startupbudget = 0.f;
 }
 
 int ParseInt(int* r, const char* str)
@@ -23,8 +48,8 @@ int ParseInt(int* r, const char* str)
     int res;
     if(sscanf(str, "%d", &res) != 1)
     {
-        Message("Warning", "Error when parsing int. Falling back to default "
-                           "value.");
+        Log(LOG_WARNING, "Error when parsing int \"%s\". Falling back to "
+                         "default value.", str);
         return -1;
     }
     else
@@ -39,8 +64,8 @@ int ParseFloat(float* r, const char* str)
     float res;
     if(sscanf(str, "%f", &res) != 1)
     {
-        Message("Warning", "Error when parsing float. Falling back to default "
-                           "value.");
+        Log(LOG_WARNING, "Error when parsing float \"%s\". Falling back to "
+                         "default value.", str);
         return -1;
     }
     else
@@ -59,10 +84,10 @@ static void HandleVideoSetting(Settings* settings, const char* key,
         else if(strcmp(value, "1") == 0) settings->video.fullscreen = 1;
         else
         {
-            Message("Warning",
-                    "Invalid value of for key \"fullscreen\". Valid values"
-                    "are 0 for windowed mode, or 1 for fullscreen mode. "
-                    "Falling back to default value of 0.");
+            Log(LOG_WARNING,
+                "Invalid value of for key \"fullscreen\". Valid values"
+                "are 0 for windowed mode, or 1 for fullscreen mode. "
+                "Falling back to default value of 0.");
         }
     }
     else if(strcmp(key, "width") == 0)
@@ -75,10 +100,48 @@ static void HandleVideoSetting(Settings* settings, const char* key,
         else if(strcmp(value, "1") == 0) settings->video.vsync = 1;
         else
         {
-            Message("Warning",
-                    "Invalid value of for key \"vsync\". Valid values"
-                    "are 0 for enabled, or 1 for disabled. "
-                    "Falling back to default value of 1.");
+            Log(LOG_WARNING,
+                "Invalid value of for key \"vsync\". Valid values"
+                "are 0 for enabled, or 1 for disabled. "
+                "Falling back to default value of 1.");
+        }
+    }
+    else if(strcmp(key, "idle") == 0)
+    {
+        if(strcmp(value, "0") == 0) settings->video.idle = 0;
+        else if(strcmp(value, "1") == 0) settings->video.idle = 1;
+        else
+        {
+            Log(LOG_WARNING,
+                "Invalid value of for key \"idle\". Valid values"
+                "are 0 for always rendering, or 1 for skipping frames "
+                "when nothing changed. Falling back to default value "
+                "of 1.");
+        }
+    }
+    else if(strcmp(key, "headless") == 0)
+    {
+        if(strcmp(value, "0") == 0) settings->video.headless = 0;
+        else if(strcmp(value, "1") == 0) settings->video.headless = 1;
+        else
+        {
+            Log(LOG_WARNING,
+                "Invalid value of for key \"headless\". Valid values "
+                "are 0 for rendering to a window, or 1 for rendering "
+                "offscreen without a display. Falling back to default "
+                "value of 0.");
+        }
+    }
+    else if(strcmp(key, "hud") == 0)
+    {
+        if(strcmp(value, "0") == 0) settings->video.hud = 0;
+        else if(strcmp(value, "1") == 0) settings->video.hud = 1;
+        else
+        {
+            Log(LOG_WARNING,
+                "Invalid value of for key \"hud\". Valid values are 0 "
+                "for hiding the performance overlay, or 1 for showing "
+                "it. Falling back to default value of 0.");
         }
     }
     else if(strcmp(key, "fov") == 0)
@@ -98,6 +161,138 @@ static void HandleGraphicsSetting(Settings* settings, const char* key,
 {
     if(strcmp(key, "viewdistance") == 0)
         ParseFloat(&settings->graphics.viewdistance, value);
+    else if(strcmp(key, "autoviewdistance") == 0)
+    {
+        if(strcmp(value, "0") == 0) settings->graphics.autoviewdistance = 0;
+        else if(strcmp(value, "1") == 0)
+            settings->graphics.autoviewdistance = 1;
+        else
+        {
+            Log(LOG_WARNING,
+                "Invalid value of for key \"autoviewdistance\". Valid "
+                "values are 0 for disabled, or 1 for enabled. "
+                "Falling back to default value of 0.");
+        }
+    }
+    else if(strcmp(key, "frametimebudget") == 0)
+        ParseFloat(&settings->graphics.frametimebudget, value);
+    else if(strcmp(key, "minviewdistance") == 0)
+        ParseFloat(&settings->graphics.minviewdistance, value);
+    else if(strcmp(key, "maxviewdistance") == 0)
+        ParseFloat(&settings->graphics.maxviewdistance, value);
+    else if(strcmp(key, "multidraw") == 0)
+    {
+        if(strcmp(value, "0") == 0) settings->graphics.multidraw = 0;
+        else if(strcmp(value, "1") == 0) settings->graphics.multidraw = 1;
+        else
+        {
+            Log(LOG_WARNING,
+                "Invalid value of for key \"multidraw\". Valid values "
+                "are 0 for instanced drawing, or 1 for multi-draw-"
+                "indirect when supported. Falling back to default "
+                "value of 1.");
+        }
+    }
+    else if(strcmp(key, "gpuculling") == 0)
+    {
+        if(strcmp(value, "0") == 0) settings->graphics.gpuculling = 0;
+        else if(strcmp(value, "1") == 0) settings->graphics.gpuculling = 1;
+        else
+        {
+            Log(LOG_WARNING,
+                "Invalid value of for key \"gpuculling\". Valid values "
+                "are 0 for culling tiles on the CPU, or 1 for a compute "
+                "shader when supported. Falling back to default value "
+                "of 1.");
+        }
+    }
+    else if(strcmp(key, "occlusionculling") == 0)
+    {
+        if(strcmp(value, "0") == 0) settings->graphics.occlusionculling = 0;
+        else if(strcmp(value, "1") == 0)
+            settings->graphics.occlusionculling = 1;
+        else
+        {
+            Log(LOG_WARNING,
+                "Invalid value of for key \"occlusionculling\". Valid "
+                "values are 0 for no occlusion culling, or 1 for skipping "
+                "tiles hidden behind nearer terrain. Falling back to "
+                "default value of 0.");
+        }
+    }
+    else if(strcmp(key, "horizonculling") == 0)
+    {
+        if(strcmp(value, "0") == 0) settings->graphics.horizonculling = 0;
+        else if(strcmp(value, "1") == 0) settings->graphics.horizonculling = 1;
+        else
+        {
+            Log(LOG_WARNING,
+                "Invalid value of for key \"horizonculling\". Valid "
+                "values are 0 for no horizon culling, or 1 for skipping "
+                "tiles below the horizon of nearer terrain. Falling back "
+                "to default value of 0.");
+        }
+    }
+    else if(strcmp(key, "tilecache") == 0)
+    {
+        if(strcmp(value, "0") == 0) settings->graphics.tilecache = 0;
+        else if(strcmp(value, "1") == 0) settings->graphics.tilecache = 1;
+        else
+        {
+            Log(LOG_WARNING,
+                "Invalid value of for key \"tilecache\". Valid values "
+                "are 0 for displacing the terrain every frame, or 1 for "
+                "caching displaced tiles when supported. Falling back to "
+                "default value of 0.");
+        }
+    }
+    else if(strcmp(key, "tilebaking") == 0)
+    {
+        if(strcmp(value, "0") == 0) settings->graphics.tilebaking = 0;
+        else if(strcmp(value, "1") == 0) settings->graphics.tilebaking = 1;
+        else
+        {
+            Log(LOG_WARNING,
+                "Invalid value of for key \"tilebaking\". Valid values "
+                "are 0 for displacing the terrain every frame, or 1 for "
+                "baking tile heights once per tile. Falling back to "
+                "default value of 0.");
+        }
+    }
+    else if(strcmp(key, "tilegenerator") == 0)
+    {
+        if(strcmp(value, "gpu") == 0)
+            settings->graphics.tilegenerator = GENERATOR_GPU;
+        else if(strcmp(value, "cpu") == 0)
+            settings->graphics.tilegenerator = GENERATOR_CPU;
+        else
+        {
+            Log(LOG_WARNING,
+                "Invalid value of for key \"tilegenerator\". Valid values "
+                "are gpu for baking tile heights in a compute shader when "
+                "supported, or cpu for baking them on the CPU. Falling "
+                "back to default value of gpu.");
+        }
+    }
+    else if(strcmp(key, "farviewdistance") == 0)
+        ParseFloat(&settings->graphics.farviewdistance, value);
+    else if(strcmp(key, "impostormove") == 0)
+        ParseFloat(&settings->graphics.impostormove, value);
+    else if(strcmp(key, "impostorerror") == 0)
+        ParseFloat(&settings->graphics.impostorerror, value);
+    else if(strcmp(key, "programcache") == 0)
+    {
+        if(strcmp(value, "0") == 0) settings->graphics.programcache = 0;
+        else if(strcmp(value, "1") == 0) settings->graphics.programcache = 1;
+        else
+        {
+            Log(LOG_WARNING,
+                "Invalid value of for key \"programcache\". Valid values "
+                "are 0 for compiling the shaders at every start, or 1 for "
+                "keeping linked programs in the shadercache directory. "
+                "Falling back to default value of 1.");
+        }
+    }
 }
 
 static void HandleControlsSetting(Settings* settings, const char* key,
@@ -113,6 +308,52 @@ static void HandleControlsSetting(Settings* settings, const char* key,
         ParseFloat(&settings->controls.ysensitivity, value);
 }
 
+static void HandleCaptureSetting(Settings* settings, const char* key,
+                                 const char* value)
+{
+    if(strcmp(key, "screenshotformat") == 0)
+    {
+        if(strcmp(value, "ppm") == 0) settings->capture.png = 0;
+        else if(strcmp(value, "png") == 0) settings->capture.png = 1;
+        else
+        {
+            Log(LOG_WARNING,
+                "Invalid value of for key \"screenshotformat\". Valid "
+                "values are ppm or png. Falling back to default value of "
+                "png.");
+        }
+    }
+    else if(strcmp(key, "fps") == 0)
+        ParseInt(&settings->capture.fps, value);
+}
+
+static void HandleLogSetting(Settings* settings, const char* key,
+                             const char* value)
+{
+    if(strcmp(key, "level") == 0)
+    {
+        if(strcmp(value, "debug") == 0) settings->log.level = LOG_DEBUG;
+        else if(strcmp(value, "info") == 0) settings->log.level = LOG_INFO;
+        else if(strcmp(value, "warning") == 0)
+            settings->log.level = LOG_WARNING;
+        else if(strcmp(value, "error") == 0) settings->log.level = LOG_ERROR;
+        else
+        {
+            Log(LOG_WARNING,
+                "Invalid value of for key \"level\". Valid values are "
+                "debug, info, warning or error. Falling back to default "
+                "value of info.");
+        }
+    }
+}
+
+static void HandleBenchmarkSetting(Settings* settings, const char* key,
+                                   const char* value)
+{
+    if(strcmp(key, "startupbudget") == 0)
+        ParseFloat(&settings->benchmark.startupbudget, value);
+}
+
 static int IniHandler(void* data, const char* section, const char* key,
                       const char* value)
 {
@@ -123,6 +364,12 @@ static int IniHandler(void* data, const char* section, const char* key,
         HandleGraphicsSetting(settings, key, value);
     else if(strcmp(section, "controls") == 0)
         HandleControlsSetting(settings, key, value);
+    else if(strcmp(section, "capture") == 0)
+        HandleCaptureSetting(settings, key, value);
+    else if(strcmp(section, "log") == 0)
+        HandleLogSetting(settings, key, value);
+    else if(strcmp(section, "benchmark") == 0)
+        HandleBenchmarkSetting(settings, key, value);
     return 1;
 }
 
@@ -8,17 +8,46 @@ typedef struct
         char fullscreen;
         int width, height;
         char vsync;
+        char idle;
+        char headless;
+        char hud;
         float pfov, pnear, pfar;
     } video;
     struct
     {
         float viewdistance;
+        char autoviewdistance;
+        float frametimebudget;
+        float minviewdistance, maxviewdistance;
+        char multidraw;
+        char gpuculling;
+        char occlusionculling;
+        char horizonculling;
+        char tilecache;
+        char tilebaking;
+        char tilegenerator; //A GeneratorBackend
+        float farviewdistance;
+        float impostormove, impostorerror;
+        char programcache;
     } graphics;
     struct
     {
         float speed1, speed2;
         float xsensitivity, ysensitivity;
     } controls;
+    struct
+    {
+        char png;
+        int fps;
+    } capture;
+    struct
+    {
+        char level; //A LogLevel
+    } log;
+    struct
+    {
+        float startupbudget; //Milliseconds to the first frame, 0 for none
+    } benchmark;
 } Settings;
 
 void ConstructSettings(Settings* settings);
@@ -0,0 +1,139 @@
+#include "ShaderReloader.h"
+#include "PT.h"
+
+static int ReloaderThread(void* data)
+{
+    ShaderReloader* reloader = data;
+    SetProfileThreadName("Shaders");
+    if(MakeWorkerContextCurrent(reloader->context) < 0)
+    {
+        Log(LOG_WARNING, "Could not use the context for reloading shaders: "
+            "%s. Shaders will not be reloaded.", SDL_GetError());
+        return -1;
+    }
+    for(;;)
+    {
+        SDL_SemWait(reloader->wake);
+        if(__atomic_load_n(&reloader->stopping, __ATOMIC_ACQUIRE)) break;
+        unsigned int pending = __atomic_exchange_n(&reloader->pending, 0,
+                                                   __ATOMIC_ACQ_REL);
+        int i;
+        for(i = 0; i < reloader->program_count; i++)
+        {
+            if(!(pending & 1 << i)) continue;
+            ReloadedProgram* p = &reloader->programs[i];
+            PROFILE_SCOPE("ReloadProgram");
+            GLuint program;
+            if(BuildProgram(&program, p->count, p->sources, p->varying_count,
+                            p->varyings) < 0)
+            {
+                Log(LOG_WARNING, "Could not reload the %s program, keeping "
+                    "the old one.", p->name);
+                continue;
+            }
+            //The main context may only use the program once it is built.
+            glFinish();
+            GLuint old = __atomic_exchange_n(&p->ready, program,
+                                             __ATOMIC_ACQ_REL);
+            if(old) glDeleteProgram(old);
+            Log(LOG_INFO, "Reloaded the %s program.", p->name);
+        }
+    }
+    MakeWorkerContextCurrent(NULL);
+    return 0;
+}
+
+int ConstructShaderReloader(ShaderReloader* reloader)
+{
+    reloader->stopping = 0;
+    reloader->pending = 0;
+    reloader->program_count = 0;
+    reloader->thread = NULL;
+    reloader->context = CreateWorkerContext();
+    if(!reloader->context) return -1;
+    reloader->wake = SDL_CreateSemaphore(0);
+    if(!reloader->wake)
+    {
+        DestroyWorkerContext(reloader->context);
+        return -1;
+    }
+    reloader->thread = SDL_CreateThread(ReloaderThread, "Shaders", reloader);
+    if(!reloader->thread)
+    {
+        SDL_DestroySemaphore(reloader->wake);
+        DestroyWorkerContext(reloader->context);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Rebuilds a program from the sources whenever one of them is written,
+ * capturing varyings like BuildProgram. The name, file names, defines and
+ * varyings must stay valid while the reloader exists.
+ * Returns the index to take the rebuilt program with, or -1 on failure.
+ */
+int AddReloadedProgram(ShaderReloader* reloader, Watcher* watcher,
+                       const char* name, GLsizei count,
+                       const ShaderSource* sources, GLsizei varying_count,
+                       const char** varyings)
+{
+    if(reloader->program_count == RELOADER_PROGRAMS ||
+       count > PROGRAM_MAX_SHADERS)
+        return -1;
+    ReloadedProgram* p = &reloader->programs[reloader->program_count];
+    p->name = name;
+    p->count = count;
+    p->varying_count = varying_count;
+    p->varyings = varyings;
+    p->files = 0;
+    p->ready = 0;
+    int i;
+    for(i = 0; i < count; i++)
+    {
+        p->sources[i] = sources[i];
+        p->files |= WatchFile(watcher, sources[i].file);
+    }
+    return reloader->program_count++;
+}
+
+//Starts rebuilding the programs using any of the changed watcher bits.
+void ReloadShaders(ShaderReloader* reloader, unsigned int changed)
+{
+    unsigned int pending = 0;
+    int i;
+    for(i = 0; i < reloader->program_count; i++)
+        if(reloader->programs[i].files & changed) pending |= 1 << i;
+    if(!pending) return;
+    __atomic_or_fetch(&reloader->pending, pending, __ATOMIC_RELEASE);
+    SDL_SemPost(reloader->wake);
+}
+
+/*
+ * Gets a program rebuilt since the last call, or 0 if there is none. The
+ * caller owns it and the program it replaces.
+ */
+GLuint TakeReloadedProgram(ShaderReloader* reloader, int program)
+{
+    if(program < 0 || program >= reloader->program_count) return 0;
+    return __atomic_exchange_n(&reloader->programs[program].ready, 0,
+                               __ATOMIC_ACQ_REL);
+}
+
+//Waits for a rebuild in progress to finish and stops the thread.
+void DestroyShaderReloader(ShaderReloader* reloader)
+{
+    if(!reloader->thread) return;
+    __atomic_store_n(&reloader->stopping, 1, __ATOMIC_RELEASE);
+    SDL_SemPost(reloader->wake);
+    SDL_WaitThread(reloader->thread, NULL);
+    reloader->thread = NULL;
+    SDL_DestroySemaphore(reloader->wake);
+    int i;
+    for(i = 0; i < reloader->program_count; i++)
+    {
+        GLuint program = reloader->programs[i].ready;
+        if(program) glDeleteProgram(program);
+    }
+    DestroyWorkerContext(reloader->context);
+}
@@ -0,0 +1,49 @@
+#ifndef SHADERRELOADER_H_
+#define SHADERRELOADER_H_
+
+#include <SDL2/SDL.h>
+#include <glad/glad.h>
+#include "Shaders.h"
+#include "Watcher.h"
+
+#define RELOADER_PROGRAMS 4 //Most programs rebuilt
+
+typedef struct
+{
+    const char* name;
+    ShaderSource sources[PROGRAM_MAX_SHADERS];
+    GLsizei count;
+    GLsizei varying_count; //Captured with transform feedback
+    const char** varyings;
+    unsigned int files; //Watcher bits of the sources
+    GLuint ready;       //Rebuilt program not taken yet, or 0
+} ReloadedProgram;
+
+/*
+ * Rebuilds programs when their shader files are saved, on a background
+ * thread with its own GL context sharing objects with the main one, so the
+ * render loop never waits for the compiler. A rebuilt program is only
+ * handed over once it links; if it doesn't, the errors are logged and the
+ * old program stays in use.
+ */
+typedef struct
+{
+    void* context;
+    SDL_Thread* thread;
+    SDL_sem* wake;
+    char stopping;
+    unsigned int pending; //Bits of the programs to rebuild
+    ReloadedProgram programs[RELOADER_PROGRAMS];
+    int program_count;
+} ShaderReloader;
+
+int ConstructShaderReloader(ShaderReloader* reloader);
+int AddReloadedProgram(ShaderReloader* reloader, Watcher* watcher,
+                       const char* name, GLsizei count,
+                       const ShaderSource* sources, GLsizei varying_count,
+                       const char** varyings);
+void ReloadShaders(ShaderReloader* reloader, unsigned int changed);
+GLuint TakeReloadedProgram(ShaderReloader* reloader, int program);
+void DestroyShaderReloader(ShaderReloader* reloader);
+
+#endif
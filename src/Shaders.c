@@ -1,13 +1,26 @@
 #include "Shaders.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
 #include "PT.h"
 
-int CreateShader(GLuint* dst, GLenum type, GLsizei count, const char** source)
+//Starts compiling a shader without waiting for the result.
+static GLuint SubmitShader(GLenum type, GLsizei count, const char** source)
 {
     GLuint handle = glCreateShader(type);
     glShaderSource(handle, count, source, NULL);
     glCompileShader(handle);
+    return handle;
+}
+
+//Waits for a shader to compile, logging the errors if it failed.
+static int CheckShader(GLuint handle)
+{
     GLint status = 0;
     glGetShaderiv(handle, GL_COMPILE_STATUS, &status);
     if(status == GL_FALSE)
@@ -16,8 +29,18 @@ int CreateShader(GLuint* dst, GLenum type, GLsizei count, const char** source)
         glGetShaderiv(handle, GL_INFO_LOG_LENGTH, &len);
         char* log = malloc(len);
         glGetShaderInfoLog(handle, len, &len, log);
-        Message("Error when compiling shader", log);
+        Log(LOG_ERROR, "Error when compiling shader:\n%s", log);
         free(log);
+        return -1;
+    }
+    return 0;
+}
+
+int CreateShader(GLuint* dst, GLenum type, GLsizei count, const char** source)
+{
+    GLuint handle = SubmitShader(type, count, source);
+    if(CheckShader(handle) < 0)
+    {
         glDeleteShader(handle);
         return -1;
     }
@@ -26,12 +49,18 @@ int CreateShader(GLuint* dst, GLenum type, GLsizei count, const char** source)
 }
 
 int LoadShader(GLuint* dst, GLenum type, const char* file)
+{
+    return LoadShaderVariant(dst, type, file, NULL);
+}
+
+//Reads a whole source file. Returns NULL if it can't be read.
+static char* ReadSource(const char* file, long* length)
 {
     FILE* f = fopen(file, "r");
     if(!f)
     {
-        Message("Error", "Could not open file.");
-        return -1;
+        Log(LOG_ERROR, "Could not open shader file \"%s\".", file);
+        return NULL;
     }
     fseek(f, 0, SEEK_END);
     long len = ftell(f);
@@ -40,19 +69,73 @@ int LoadShader(GLuint* dst, GLenum type, const char* file)
     if(!src)
     {
         fclose(f);
-        Message("Error", "Memory allocation error.");
-        return -2;
+        Log(LOG_ERROR, "Memory allocation error.");
+        return NULL;
     }
-    fread(src, 1, len, f);
+    len = fread(src, 1, len, f);
     fclose(f);
     src[len] = 0;
-    int r = CreateShader(dst, type, 1, (const char**)&src);
+    *length = len;
+    return src;
+}
+
+//Starts compiling source with defines inserted, see LoadShaderVariant.
+//Changes src.
+static GLuint SubmitVariant(GLenum type, char* src, long len,
+                            const char* defines)
+{
+    if(!defines) return SubmitShader(type, 1, (const char**)&src);
+    char* body = src;
+    char* version = strstr(src, "#version");
+    if(version)
+    {
+        body = strchr(version, '\n');
+        body = body ? body + 1 : src + len;
+    }
+    if(strncmp(defines, "#version", 8) == 0 && version)
+        memset(version, ' ', body - version);
+    char* head = malloc(body - src + 1);
+    memcpy(head, src, body - src);
+    head[body - src] = 0;
+    const char* sources[] = { head, defines, body };
+    GLuint handle = SubmitShader(type, 3, sources);
+    free(head);
+    return handle;
+}
+
+/*
+ * Loads a shader with extra lines (#define, #extension) inserted right after
+ * its #version directive. If the lines start with a #version directive of
+ * their own, it replaces the one in the file, so shared code like Noise.glsl
+ * can be built for stages that need a newer version.
+ */
+int LoadShaderVariant(GLuint* dst, GLenum type, const char* file,
+                      const char* defines)
+{
+    long len;
+    char* src = ReadSource(file, &len);
+    if(!src) return -1;
+    GLuint handle = SubmitVariant(type, src, len, defines);
     free(src);
-    if(r < 0) return -3;
-    else return 0;
+    if(CheckShader(handle) < 0)
+    {
+        glDeleteShader(handle);
+        return -3;
+    }
+    *dst = handle;
+    return 0;
 }
 
 int CreateProgram(GLuint* dst, GLsizei count, GLuint* shaders)
+{
+    return CreateFeedbackProgram(dst, count, shaders, 0, NULL);
+}
+
+//Starts linking a program without waiting for the result. Returns 0 if the
+//shaders can't be attached.
+static GLuint SubmitProgram(GLsizei count, GLuint* shaders,
+                            GLsizei varying_count, const char** varyings,
+                            char retrievable)
 {
     GLuint handle = glCreateProgram();
     int i;
@@ -63,11 +146,24 @@ int CreateProgram(GLuint* dst, GLsizei count, GLuint* shaders)
     }
     if(i < count)
     {
-        Message("Error", "Error when attaching shader.");
+        Log(LOG_ERROR, "Error when attaching shader.");
         glDeleteProgram(handle);
-        return -1;
+        return 0;
     }
+    if(varying_count > 0)
+    {
+        glTransformFeedbackVaryings(handle, varying_count, varyings,
+                                    GL_INTERLEAVED_ATTRIBS);
+    }
+    if(retrievable)
+        glProgramParameteri(handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, 1);
     glLinkProgram(handle);
+    return handle;
+}
+
+//Waits for a program to link, logging the errors if it failed.
+static int CheckProgram(GLuint handle)
+{
     GLint status = 0;
     glGetProgramiv(handle, GL_LINK_STATUS, &status);
     if(status == GL_FALSE)
@@ -76,11 +172,308 @@ int CreateProgram(GLuint* dst, GLsizei count, GLuint* shaders)
         glGetProgramiv(handle, GL_INFO_LOG_LENGTH, &len);
         char* log = malloc(len);
         glGetProgramInfoLog(handle, len, &len, log);
-        Message("Error when linking program", log);
+        Log(LOG_ERROR, "Error when linking program:\n%s", log);
         free(log);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Creates a program whose vertex shader outputs named in varyings are
+ * captured with transform feedback, interleaved in one buffer.
+ */
+int CreateFeedbackProgram(GLuint* dst, GLsizei count, GLuint* shaders,
+                          GLsizei varying_count, const char** varyings)
+{
+    GLuint handle = SubmitProgram(count, shaders, varying_count, varyings, 0);
+    if(!handle) return -1;
+    if(CheckProgram(handle) < 0)
+    {
         glDeleteProgram(handle);
         return -2;
     }
     *dst = handle;
     return 0;
 }
+
+typedef struct
+{
+    char magic[4];
+    GLenum format;
+    GLint length;
+    uint64_t key;
+} ProgramBinaryHeader;
+
+static const char PROGRAM_BINARY_MAGIC[4] = { 'P', 'T', 'P', 'B' };
+static char* cache_directory;
+
+/*
+ * Keeps linked programs built by BuildProgram as driver binaries in a
+ * directory, created if needed, and loads them from there instead of
+ * compiling when nothing they depend on has changed. Pass NULL to turn the
+ * cache off. Needs GL 4.1 and a driver with at least one binary format.
+ */
+void SetProgramCache(const char* directory)
+{
+    free(cache_directory);
+    cache_directory = NULL;
+    GLint formats = 0;
+    if(GLAD_GL_VERSION_4_1)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if(!directory || formats == 0) return;
+#ifdef _WIN32
+    _mkdir(directory);
+#else
+    mkdir(directory, 0755);
+#endif
+    cache_directory = malloc(strlen(directory) + 1);
+    strcpy(cache_directory, directory);
+}
+
+//FNV-1a, to key binaries by everything the compiled program depends on.
+static uint64_t Hash(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = data;
+    size_t i;
+    for(i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+//Hashes the string with its terminator, so consecutive strings can't blur.
+static uint64_t HashString(uint64_t hash, const char* string)
+{
+    if(!string) string = "";
+    return Hash(hash, string, strlen(string) + 1);
+}
+
+/*
+ * Loads a program binary saved under key. Fails quietly if there is none,
+ * or the driver rejects it, e.g. after an update that kept the version.
+ */
+static int LoadProgramBinary(GLuint* dst, const char* path, uint64_t key)
+{
+    FILE* f = fopen(path, "rb");
+    if(!f) return -1;
+    ProgramBinaryHeader header;
+    void* data = NULL;
+    if(fread(&header, sizeof(header), 1, f) != 1 ||
+       memcmp(header.magic, PROGRAM_BINARY_MAGIC, 4) != 0 ||
+       header.key != key || header.length <= 0 ||
+       !(data = malloc(header.length)) ||
+       fread(data, header.length, 1, f) != 1)
+    {
+        fclose(f);
+        free(data);
+        return -1;
+    }
+    fclose(f);
+    GLuint handle = glCreateProgram();
+    //A format the driver doesn't know is an error, not just a failed link,
+    //so errors left by earlier calls must not be taken for it.
+    while(glGetError() != GL_NO_ERROR);
+    glProgramBinary(handle, header.format, data, header.length);
+    GLenum error = glGetError();
+    free(data);
+    GLint status = GL_FALSE;
+    glGetProgramiv(handle, GL_LINK_STATUS, &status);
+    if(error != GL_NO_ERROR || status == GL_FALSE)
+    {
+        Log(LOG_DEBUG, "Program binary %s was rejected.", path);
+        glDeleteProgram(handle);
+        return -1;
+    }
+    *dst = handle;
+    return 0;
+}
+
+//Saves a program binary, through a temporary file so readers never see
+//half of one.
+static void SaveProgramBinary(GLuint program, const char* path, uint64_t key)
+{
+    ProgramBinaryHeader header;
+    memcpy(header.magic, PROGRAM_BINARY_MAGIC, 4);
+    header.key = key;
+    header.length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+    if(header.length <= 0) return;
+    void* data = malloc(header.length);
+    if(!data) return;
+    glGetProgramBinary(program, header.length, &header.length,
+                       &header.format, data);
+    char temporary[512];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE* f = fopen(temporary, "wb");
+    if(f)
+    {
+        char written = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                       fwrite(data, header.length, 1, f) == 1;
+        written = fclose(f) == 0 && written;
+        if(!written || rename(temporary, path) != 0)
+        {
+            remove(temporary);
+            Log(LOG_WARNING, "Could not write program binary %s.", path);
+        }
+        else Log(LOG_DEBUG, "Saved program binary %s.", path);
+    }
+    free(data);
+}
+
+//Names a program after its shader files, like Noise+Fragment.
+static void NameProgram(ProgramBuild* build, GLsizei count,
+                        const ShaderSource* sources)
+{
+    size_t length = 0;
+    int i;
+    build->name[0] = 0;
+    for(i = 0; i < count && length + 1 < sizeof(build->name); i++)
+    {
+        const char* file = sources[i].file;
+        const char* slash = strrchr(file, '/');
+        if(slash) file = slash + 1;
+        const char* dot = strrchr(file, '.');
+        int n = dot ? (int)(dot - file) : (int)strlen(file);
+        length += snprintf(build->name + length, sizeof(build->name) - length,
+                           "%s%.*s", i > 0 ? "+" : "", n, file);
+    }
+}
+
+/*
+ * Starts building a program from shader files, each with optional lines
+ * inserted after #version as in LoadShaderVariant, capturing varyings with
+ * transform feedback if varying_count is above 0. Nothing waits for the
+ * compiler here, so with KHR_parallel_shader_compile the driver builds
+ * several programs at once while the caller does other work until
+ * FinishProgram. With the program cache on, a binary of the program is
+ * loaded instead when the sources, defines, varyings and GL driver match
+ * one built before. If this fails, so does FinishProgram.
+ */
+int StartProgram(ProgramBuild* build, GLsizei count,
+                 const ShaderSource* sources, GLsizei varying_count,
+                 const char** varyings)
+{
+    char* texts[PROGRAM_MAX_SHADERS];
+    long lengths[PROGRAM_MAX_SHADERS];
+    uint64_t key = 14695981039346656037ull;
+    int i;
+    build->program = 0;
+    build->count = 0;
+    if(count > PROGRAM_MAX_SHADERS) return -1;
+    NameProgram(build, count, sources);
+    int phase = BeginStartupPhase("Compile %s", build->name);
+    for(i = 0; i < count; i++)
+    {
+        texts[i] = ReadSource(sources[i].file, &lengths[i]);
+        if(!texts[i])
+        {
+            while(i-- > 0) free(texts[i]);
+            EndStartupPhase(phase);
+            return -1;
+        }
+        key = Hash(key, &sources[i].type, sizeof(GLenum));
+        key = HashString(key, sources[i].defines);
+        key = HashString(key, texts[i]);
+    }
+    for(i = 0; i < varying_count; i++) key = HashString(key, varyings[i]);
+    key = HashString(key, (const char*)glGetString(GL_VENDOR));
+    key = HashString(key, (const char*)glGetString(GL_RENDERER));
+    key = HashString(key, (const char*)glGetString(GL_VERSION));
+    build->key = key;
+
+    if(cache_directory)
+    {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%016llx.bin", cache_directory,
+                 (unsigned long long)key);
+        if(LoadProgramBinary(&build->program, path, key) == 0)
+        {
+            Log(LOG_DEBUG, "Loaded program binary %s.", path);
+            for(i = 0; i < count; i++) free(texts[i]);
+            EndStartupPhase(phase);
+            return 0;
+        }
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        build->shaders[i] = SubmitVariant(sources[i].type, texts[i],
+                                          lengths[i], sources[i].defines);
+        free(texts[i]);
+    }
+    build->count = count;
+    build->program = SubmitProgram(count, build->shaders, varying_count,
+                                   varyings, cache_directory != NULL);
+    EndStartupPhase(phase);
+    if(!build->program)
+    {
+        FinishProgram(build, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+//Checks without blocking if a started program is done building.
+char IsProgramReady(ProgramBuild* build)
+{
+    if(!build->program || build->count == 0 ||
+       !GLAD_GL_KHR_parallel_shader_compile)
+        return 1;
+    GLint done = GL_TRUE;
+    glGetProgramiv(build->program, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+/*
+ * Waits for a started program and gets it, logging compiler errors if any
+ * shader failed, or linker errors if it didn't link. Pass NULL for dst to
+ * throw the program away unchecked, which does nothing if the build was
+ * already finished.
+ */
+int FinishProgram(ProgramBuild* build, GLuint* dst)
+{
+    int err = build->program && dst ? 0 : -1;
+    int i;
+    if(err == 0 && !IsProgramReady(build))
+        Log(LOG_DEBUG, "Waiting for %s to build.", build->name);
+    int phase = err == 0 ? BeginStartupPhase("Link %s", build->name) : -1;
+    if(err == 0 && build->count > 0)
+    {
+        GLint status = GL_FALSE;
+        glGetProgramiv(build->program, GL_LINK_STATUS, &status);
+        if(status == GL_FALSE)
+        {
+            for(i = 0; i < build->count; i++)
+                if(CheckShader(build->shaders[i]) < 0) err = -2;
+            if(err == 0) CheckProgram(build->program);
+            if(err == 0) err = -3;
+        }
+    }
+    for(i = 0; i < build->count; i++) glDeleteShader(build->shaders[i]);
+    if(err == 0 && build->count > 0 && cache_directory)
+    {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%016llx.bin", cache_directory,
+                 (unsigned long long)build->key);
+        SaveProgramBinary(build->program, path, build->key);
+    }
+    build->count = 0;
+    if(err == 0) *dst = build->program;
+    else if(build->program) glDeleteProgram(build->program);
+    build->program = 0;
+    EndStartupPhase(phase);
+    return err;
+}
+
+//Builds a program right away, see StartProgram.
+int BuildProgram(GLuint* dst, GLsizei count, const ShaderSource* sources,
+                 GLsizei varying_count, const char** varyings)
+{
+    ProgramBuild build;
+    if(StartProgram(&build, count, sources, varying_count, varyings) < 0)
+        return -1;
+    return FinishProgram(&build, dst);
+}
@@ -3,8 +3,39 @@
 
 #include <glad/glad.h>
 
+#define PROGRAM_MAX_SHADERS 4
+
+typedef struct
+{
+    GLenum type;
+    const char* file;
+    const char* defines; //Lines inserted after #version, or NULL
+} ShaderSource;
+
+//A program started by StartProgram, until FinishProgram.
+typedef struct
+{
+    GLuint program;
+    GLuint shaders[PROGRAM_MAX_SHADERS];
+    GLsizei count; //Shaders compiling, 0 if loaded from the cache
+    unsigned long long key;
+    char name[40]; //Shader files without extensions, for the startup timeline
+} ProgramBuild;
+
 int CreateShader(GLuint* dst, GLenum type, GLsizei count, const char** source);
 int LoadShader(GLuint* dst, GLenum type, const char* file);
+int LoadShaderVariant(GLuint* dst, GLenum type, const char* file,
+                      const char* defines);
 int CreateProgram(GLuint* dst, GLsizei count, GLuint* shaders);
+int CreateFeedbackProgram(GLuint* dst, GLsizei count, GLuint* shaders,
+                          GLsizei varying_count, const char** varyings);
+void SetProgramCache(const char* directory);
+int StartProgram(ProgramBuild* build, GLsizei count,
+                 const ShaderSource* sources, GLsizei varying_count,
+                 const char** varyings);
+char IsProgramReady(ProgramBuild* build);
+int FinishProgram(ProgramBuild* build, GLuint* dst);
+int BuildProgram(GLuint* dst, GLsizei count, const ShaderSource* sources,
+                 GLsizei varying_count, const char** varyings);
 
 #endif
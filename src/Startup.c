@@ -0,0 +1,85 @@
+#include "Startup.h"
+#include "Profiler.h"
+#include "Log.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+
+typedef struct
+{
+    char name[STARTUP_NAME];
+    int depth;
+    double start, end; //Seconds since InitStartup, end negative until ended
+    ProfileScope scope;
+} StartupPhase;
+
+static StartupPhase phases[STARTUP_PHASES];
+static int phase_count, depth;
+static char finished;
+static __thread char main_thread; //Set on the thread that called InitStartup
+static struct timespec start;
+
+static double Elapsed()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec)*1e-9;
+}
+
+//Starts the clock. Call first thing in main.
+void InitStartup()
+{
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    main_thread = 1;
+    phase_count = 0;
+    depth = 0;
+    finished = 0;
+}
+
+//Starts timing a phase named by a format string. Returns its index.
+int BeginStartupPhase(const char* format, ...)
+{
+    if(!main_thread || finished || phase_count == STARTUP_PHASES) return -1;
+    StartupPhase* p = &phases[phase_count];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(p->name, sizeof(p->name), format, args);
+    va_end(args);
+    p->depth = depth++;
+    p->start = Elapsed();
+    p->end = -1.;
+    p->scope = BeginProfileScope(p->name);
+    return phase_count++;
+}
+
+void EndStartupPhase(int phase)
+{
+    if(phase < 0 || finished) return;
+    StartupPhase* p = &phases[phase];
+    p->end = Elapsed();
+    EndProfileScope(&p->scope);
+    depth = p->depth;
+}
+
+/*
+ * Logs the timeline, once the first frame is shown. Returns the time to
+ * the first frame in milliseconds.
+ */
+double EndStartup()
+{
+    double total = Elapsed();
+    finished = 1;
+    double phased = 0.;
+    int i;
+    Log(LOG_INFO, "First frame after %.1f ms:", total*1000.);
+    for(i = 0; i < phase_count; i++)
+    {
+        StartupPhase* p = &phases[i];
+        if(p->end < 0.) continue;
+        if(p->depth == 0) phased += p->end - p->start;
+        Log(LOG_INFO, "%8.2f ms  %*s%s", (p->end - p->start)*1000.,
+            p->depth*2, "", p->name);
+    }
+    Log(LOG_INFO, "%8.2f ms  other", (total - phased)*1000.);
+    return total*1000.;
+}
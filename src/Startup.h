@@ -0,0 +1,22 @@
+#ifndef STARTUP_H_
+#define STARTUP_H_
+
+#define STARTUP_PHASES 64 //Phases recorded, later ones are ignored
+#define STARTUP_NAME 48   //Longest phase name, longer ones are cut off
+
+/*
+ * Timeline of the start of the game. Phases are timed from
+ * BeginStartupPhase to EndStartupPhase and may nest. At the first frame,
+ * EndStartup logs how long each phase took and the time to the first
+ * frame, counted from InitStartup. Phases also show in the CPU trace.
+ * Phases begun after the first frame or on other threads than the one
+ * that called InitStartup are ignored, so code that also runs later or on
+ * worker threads can be timed unconditionally.
+ */
+void InitStartup();
+int BeginStartupPhase(const char* format, ...)
+    __attribute__((format(printf, 1, 2)));
+void EndStartupPhase(int phase);
+double EndStartup();
+
+#endif
@@ -0,0 +1,986 @@
+#include "Terrain.h"
+#include "Frustum.h"
+#include "Shaders.h"
+#include "Noise.h"
+#include "Grid.h"
+#include "Startup.h"
+#include <stdlib.h>
+#include <math.h>
+
+#define OCCLUSION_INTERVAL 8 //Frames between tests of visible tiles
+#define BOUNDS_PER_FRAME 2 //Tile height ranges computed per frame
+#define HEIGHT_MARGIN 0.01f //Covers rounding differences with the GPU
+
+typedef struct
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+} DrawElementsIndirectCommand;
+
+/*
+ * Creates the vertex buffer of an n by n grid of points, step units apart.
+ */
+GLuint CreateGridVertexBuffer(int n, int step)
+{
+    int phase = BeginStartupPhase("Grid vertex buffer %d", n);
+    size_t vs_size = n*n*2*sizeof(float);
+    GLuint buf;
+    glGenBuffers(1, &buf);
+    glBindBuffer(GL_ARRAY_BUFFER, buf);
+    glBufferData(GL_ARRAY_BUFFER, vs_size, NULL, GL_STATIC_DRAW);
+    float* vs = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+    FillGridVertices(vs, n, step);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    EndStartupPhase(phase);
+    return buf;
+}
+
+/*
+ * Creates the indices of a triangle strip over an n by n grid, with
+ * degenerate triangles joining the rows.
+ */
+GLuint CreateGridIndexBuffer(int* count, int n)
+{
+    int phase = BeginStartupPhase("Grid index buffer %d", n);
+    *count = GridIndexCount(n);
+    size_t is_size = *count*sizeof(GLuint);
+    GLuint buf;
+    glGenBuffers(1, &buf);
+    glBindBuffer(GL_ARRAY_BUFFER, buf);
+    glBufferData(GL_ARRAY_BUFFER, is_size, NULL, GL_STATIC_DRAW);
+    GLuint* is = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+    FillGridIndices(is, n);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    EndStartupPhase(phase);
+    return buf;
+}
+
+static int TileRadius(float viewdistance)
+{
+    return (int)ceil(viewdistance / TERRAIN_TILE_SIZE);
+}
+
+/*
+ * Sizes the per-draw buffers for the largest number of tiles that can be
+ * visible at the current view distance. Every indirect command draws the
+ * whole tile mesh; which tile it is comes from gl_DrawIDARB.
+ */
+static void ReserveTiles(Terrain* terrain)
+{
+    int r = TileRadius(terrain->viewdistance);
+    int capacity = (2*r+1)*(2*r+1);
+    if(capacity <= terrain->capacity) return;
+    terrain->capacity = capacity;
+    terrain->visible = realloc(terrain->visible, capacity*sizeof(Tile));
+    terrain->scratch = realloc(terrain->scratch, capacity*8*sizeof(float));
+    if(terrain->horizonculling)
+    {
+        terrain->occluders = realloc(terrain->occluders, capacity*
+                                     TERRAIN_CELLS*TERRAIN_CELLS*
+                                     sizeof(Occluder));
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, terrain->tile_buf);
+    glBufferData(GL_TEXTURE_BUFFER, capacity*2*sizeof(float), NULL,
+                 GL_STREAM_DRAW);
+
+    if(terrain->path == TERRAIN_GPU_CULLED)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, terrain->candidate_buf);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity*8*sizeof(float),
+                     NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, terrain->indirect_buf);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                     sizeof(DrawElementsIndirectCommand), NULL,
+                     GL_DYNAMIC_DRAW);
+    }
+    else if(terrain->path == TERRAIN_MULTIDRAW)
+    {
+        DrawElementsIndirectCommand* commands =
+            malloc(capacity*sizeof(DrawElementsIndirectCommand));
+        int i;
+        for(i = 0; i < capacity; i++)
+        {
+            commands[i].count = terrain->icount;
+            commands[i].instance_count = 1;
+            commands[i].first_index = 0;
+            commands[i].base_vertex = 0;
+            commands[i].base_instance = 0;
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, terrain->indirect_buf);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                     capacity*sizeof(DrawElementsIndirectCommand), commands,
+                     GL_STATIC_DRAW);
+        free(commands);
+    }
+}
+
+static int FinishCullProgram(Terrain* terrain)
+{
+    if(FinishProgram(&terrain->build, &terrain->cull_program) < 0)
+        return -1;
+    GLuint program = terrain->cull_program;
+    terrain->cull_planes_loc = glGetUniformLocation(program, "planes");
+    terrain->cull_camera_loc = glGetUniformLocation(program, "camera");
+    terrain->cull_viewdistance_loc = glGetUniformLocation(program,
+                                                          "viewdistance");
+    terrain->cull_count_loc = glGetUniformLocation(program,
+                                                   "candidate_count");
+    return 0;
+}
+
+static const ShaderSource CAPTURE_SOURCES[] = {
+    { GL_VERTEX_SHADER, "Noise.glsl", NULL },
+    { GL_VERTEX_SHADER, "TileCapture.glsl", NULL }
+};
+static const char* CAPTURE_VARYINGS[] = { "position" };
+
+//Feeds the grid to a capture program. The capture vertex array is bound.
+static void UseCaptureProgram(Terrain* terrain, GLuint program)
+{
+    terrain->capture_program = program;
+    terrain->capture_origin_loc = glGetUniformLocation(program, "origin");
+    glBindBuffer(GL_ARRAY_BUFFER, terrain->vbuf);
+    GLint pos_loc = glGetAttribLocation(program, "grid_pos");
+    glEnableVertexAttribArray(pos_loc);
+    glVertexAttribPointer(pos_loc, 2, GL_FLOAT, GL_FALSE, 0, 0);
+}
+
+static int FinishCaptureProgram(Terrain* terrain)
+{
+    GLuint program;
+    if(FinishProgram(&terrain->build, &program) < 0) return -1;
+    glBindVertexArray(terrain->capture_vao);
+    UseCaptureProgram(terrain, program);
+    return 0;
+}
+
+/*
+ * Sets up the tile mesh and per-draw buffers, and starts building the
+ * shaders of the GPU culled, occlusion culled, cached or baked path. The
+ * terrain can't be updated until FinishTerrain, which waits for them. The
+ * baked path falls back to generating on the CPU right away if the GPU
+ * generator isn't supported. Horizon culling needs the visible tiles on
+ * the CPU, so it is ignored on the GPU culled path.
+ */
+void ConstructTerrain(Terrain* terrain, float viewdistance, TerrainPath path,
+                      GeneratorBackend generator, char horizonculling)
+{
+    const ShaderSource cull_source = {
+        GL_COMPUTE_SHADER, "TileCull.glsl", NULL
+    };
+    int n = TERRAIN_TILE_SIZE + 1;
+    terrain->viewdistance = viewdistance;
+    terrain->cull_program = 0;
+    terrain->capture_program = 0;
+    terrain->build.program = 0;
+    terrain->build.count = 0;
+    terrain->vbuf = CreateGridVertexBuffer(n, 1);
+    terrain->ibuf = CreateGridIndexBuffer(&terrain->icount, n);
+    if(path == TERRAIN_GPU_CULLED)
+        StartProgram(&terrain->build, 1, &cull_source, 0, NULL);
+    if(path == TERRAIN_OCCLUSION_CULLED)
+        ConstructOcclusion(&terrain->occlusion, OCCLUSION_INTERVAL);
+    if(path == TERRAIN_CACHED)
+    {
+        StartProgram(&terrain->build, 2, CAPTURE_SOURCES, 1,
+                     CAPTURE_VARYINGS);
+        glGenVertexArrays(1, &terrain->capture_vao);
+        glGenBuffers(1, &terrain->cache_buf);
+    }
+    if(path == TERRAIN_BAKED &&
+       ConstructTileCache(&terrain->heights, generator) < 0)
+        ConstructTileCache(&terrain->heights, GENERATOR_CPU);
+    terrain->path = path;
+    terrain->horizonculling = horizonculling && path != TERRAIN_GPU_CULLED;
+    terrain->bounds = NULL;
+    terrain->bounds_width = 0;
+    terrain->occluders = NULL;
+    terrain->unbounded = 0;
+    terrain->hidden = 0;
+    terrain->cached = NULL;
+    terrain->cache_width = 0;
+    terrain->captured = 0;
+    terrain->lookups = 0;
+    terrain->misses = 0;
+
+    glGenVertexArrays(1, &terrain->vao);
+    glBindVertexArray(terrain->vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrain->ibuf);
+
+    glGenBuffers(1, &terrain->tile_buf);
+    glGenBuffers(1, &terrain->indirect_buf);
+    glGenBuffers(1, &terrain->candidate_buf);
+    glGenTextures(1, &terrain->tile_tex);
+    terrain->radius = -1;
+    terrain->candidate_count = 0;
+    terrain->visible = NULL;
+    terrain->scratch = NULL;
+    terrain->visible_count = 0;
+    terrain->capacity = 0;
+    ReserveTiles(terrain);
+
+    glBindTexture(GL_TEXTURE_BUFFER, terrain->tile_tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, terrain->tile_buf);
+}
+
+/*
+ * Waits for the shaders started by ConstructTerrain. If the GPU culled,
+ * occlusion culled or cached path can't build its shader, the tiles are
+ * culled on the CPU and drawn instanced, and the baked path generates on
+ * the CPU. The program to draw with depends on the path that was chosen,
+ * so it is set afterwards with SetTerrainProgram.
+ */
+void FinishTerrain(Terrain* terrain)
+{
+    TerrainPath path = terrain->path;
+    if(path == TERRAIN_GPU_CULLED && FinishCullProgram(terrain) < 0)
+        path = TERRAIN_INSTANCED;
+    if(path == TERRAIN_OCCLUSION_CULLED &&
+       FinishOcclusion(&terrain->occlusion) < 0)
+    {
+        DestroyOcclusion(&terrain->occlusion);
+        path = TERRAIN_INSTANCED;
+    }
+    if(path == TERRAIN_CACHED && FinishCaptureProgram(terrain) < 0)
+    {
+        glDeleteVertexArrays(1, &terrain->capture_vao);
+        glDeleteBuffers(1, &terrain->cache_buf);
+        path = TERRAIN_INSTANCED;
+    }
+    if(path == TERRAIN_BAKED &&
+       FinishTileGenerator(&terrain->heights.generator) < 0)
+    {
+        DestroyTileCache(&terrain->heights);
+        ConstructTileCache(&terrain->heights, GENERATOR_CPU);
+    }
+    terrain->path = path;
+}
+
+/*
+ * Sets up the tile vertex array for the program the terrain is drawn with.
+ * It reads grid positions, or displaced positions from the vertex cache on
+ * the cached path.
+ */
+void SetTerrainProgram(Terrain* terrain, GLuint program)
+{
+    terrain->tile_base_loc = glGetUniformLocation(program, "tile_base");
+    terrain->layer_loc = glGetUniformLocation(program, "layer");
+    glBindVertexArray(terrain->vao);
+    if(terrain->path == TERRAIN_CACHED)
+    {
+        GLint pos_loc = glGetAttribLocation(program, "position");
+        glBindBuffer(GL_ARRAY_BUFFER, terrain->cache_buf);
+        glEnableVertexAttribArray(pos_loc);
+        glVertexAttribPointer(pos_loc, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    }
+    else
+    {
+        GLint pos_loc = glGetAttribLocation(program, "grid_pos");
+        glBindBuffer(GL_ARRAY_BUFFER, terrain->vbuf);
+        glEnableVertexAttribArray(pos_loc);
+        glVertexAttribPointer(pos_loc, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    }
+}
+
+/*
+ * Gets the sources of the program computing the tile heights on the cached
+ * and baked paths, which stay valid with the terrain. Returns how many
+ * there are, or 0 if the heights are computed by the program drawing the
+ * terrain or on the CPU.
+ */
+GLsizei GetTerrainHeightSources(Terrain* terrain, ShaderSource* sources,
+                                GLsizei* varying_count,
+                                const char*** varyings)
+{
+    *varying_count = 0;
+    *varyings = NULL;
+    if(terrain->path == TERRAIN_BAKED)
+        return GetTileGeneratorSources(&terrain->heights.generator, sources);
+    if(terrain->path != TERRAIN_CACHED) return 0;
+    sources[0] = CAPTURE_SOURCES[0];
+    sources[1] = CAPTURE_SOURCES[1];
+    *varying_count = 1;
+    *varyings = CAPTURE_VARYINGS;
+    return 2;
+}
+
+/*
+ * Replaces the program computing the tile heights with one rebuilt from
+ * the sources above, and computes every tile again with it.
+ */
+void SetTerrainHeightProgram(Terrain* terrain, RenderState* state,
+                             GLuint program)
+{
+    int i;
+    if(terrain->path == TERRAIN_BAKED)
+    {
+        SetTileGeneratorProgram(&terrain->heights.generator, state, program);
+        ClearTileCache(&terrain->heights);
+        return;
+    }
+    ForgetProgram(state, terrain->capture_program);
+    glDeleteProgram(terrain->capture_program);
+    BindVertexArray(state, terrain->capture_vao);
+    UseCaptureProgram(terrain, program);
+    for(i = 0; i < terrain->cache_width*terrain->cache_width; i++)
+        terrain->cached[i].valid = 0;
+}
+
+/*
+ * Gets the farthest view distance a path can draw. On the baked path, the
+ * tiles around the camera must fit in the layers of one texture array.
+ */
+float MaxTerrainViewDistance(TerrainPath path)
+{
+    if(path != TERRAIN_BAKED) return INFINITY;
+    return MaxTileCacheRadius() * TERRAIN_TILE_SIZE;
+}
+
+/*
+ * Changes the view distance at runtime. The tile mesh is shared by all
+ * tiles, so only the per-draw buffers may need to grow.
+ */
+void SetTerrainViewDistance(Terrain* terrain, float viewdistance)
+{
+    terrain->viewdistance = viewdistance;
+    ReserveTiles(terrain);
+}
+
+static int CompareTiles(const void* a, const void* b)
+{
+    float da = ((const Tile*)a)->distance, db = ((const Tile*)b)->distance;
+    return (da > db) - (da < db);
+}
+
+//Slot of a tile in a table that wraps around in both directions.
+static int WrapSlot(int x, int z, int width)
+{
+    int wx = x % width, wz = z % width;
+    return (wx < 0 ? wx + width : wx)*width + (wz < 0 ? wz + width : wz);
+}
+
+static TileBounds* TileSlot(Terrain* terrain, int x, int z)
+{
+    return terrain->bounds + WrapSlot(x, z, terrain->bounds_width);
+}
+
+//Sizes the bounds table to hold every tile within radius of the camera.
+static void ReserveBounds(Terrain* terrain, int r)
+{
+    int i;
+    if(terrain->bounds_width == 2*r+1) return;
+    terrain->bounds_width = 2*r+1;
+    terrain->bounds = realloc(terrain->bounds, (2*r+1)*(2*r+1)*
+                                               sizeof(TileBounds));
+    for(i = 0; i < (2*r+1)*(2*r+1); i++) terrain->bounds[i].valid = 0;
+}
+
+static int HasTileBounds(Terrain* terrain, int x, int z)
+{
+    TileBounds* bounds = TileSlot(terrain, x, z);
+    return bounds->valid && bounds->x == x && bounds->z == z;
+}
+
+/*
+ * Computes the height ranges of a tile unless they are cached. Vertices are
+ * at integer offsets from the tile origin, and the grid node stays at the
+ * world origin.
+ */
+static int UpdateTileBounds(Terrain* terrain, int x, int z)
+{
+    if(HasTileBounds(terrain, x, z)) return 0;
+    TileBounds* bounds = TileSlot(terrain, x, z);
+    int size = TERRAIN_TILE_SIZE / TERRAIN_CELLS;
+    int i, j;
+    bounds->min = TERRAIN_MAX_HEIGHT;
+    bounds->max = TERRAIN_MIN_HEIGHT;
+    for(i = 0; i < TERRAIN_CELLS; i++)
+    {
+        for(j = 0; j < TERRAIN_CELLS; j++)
+        {
+            float min, max;
+            HeightBounds(x*TERRAIN_TILE_SIZE + i*size,
+                         z*TERRAIN_TILE_SIZE + j*size, size + 1, &min, &max);
+            bounds->ground[i*TERRAIN_CELLS + j] = min - HEIGHT_MARGIN;
+            bounds->min = fminf(bounds->min, min - HEIGHT_MARGIN);
+            bounds->max = fmaxf(bounds->max, max + HEIGHT_MARGIN);
+        }
+    }
+    bounds->x = x;
+    bounds->z = z;
+    bounds->valid = 1;
+    return 1;
+}
+
+/*
+ * Gets the height range of a tile, or all possible heights if it isn't
+ * cached, which is always safe.
+ */
+static void GetTileHeights(Terrain* terrain, int x, int z, float* min,
+                           float* max)
+{
+    TileBounds* bounds = TileSlot(terrain, x, z);
+    if(HasTileBounds(terrain, x, z))
+    {
+        *min = bounds->min;
+        *max = bounds->max;
+    }
+    else
+    {
+        *min = TERRAIN_MIN_HEIGHT;
+        *max = TERRAIN_MAX_HEIGHT;
+    }
+}
+
+static int FloorDiv(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/*
+ * Gets the lowest ground in a cell, counted in cells from the world origin,
+ * or the lowest possible height if its tile isn't cached.
+ */
+static float GetCellGround(Terrain* terrain, int u, int v)
+{
+    int x = FloorDiv(u, TERRAIN_CELLS), z = FloorDiv(v, TERRAIN_CELLS);
+    TileBounds* bounds = TileSlot(terrain, x, z);
+    if(!bounds->valid || bounds->x != x || bounds->z != z)
+        return TERRAIN_MIN_HEIGHT;
+    return bounds->ground[(u - x*TERRAIN_CELLS)*TERRAIN_CELLS +
+                          v - z*TERRAIN_CELLS];
+}
+
+static int CompareOccluders(const void* a, const void* b)
+{
+    float da = ((const Occluder*)a)->farthest;
+    float db = ((const Occluder*)b)->farthest;
+    return (da > db) - (da < db);
+}
+
+/*
+ * Drops the visible tiles hidden behind nearer ground. Tiles are tested
+ * nearest first, and ground is only added to the horizon once every tile
+ * still to be tested lies entirely behind it. Ground is added per block of
+ * two by two cells, one block for every cell, so the blocks overlap and
+ * leave no gaps in the horizon along cell edges. Height ranges are costly,
+ * so only a few tiles get theirs each frame, nearest first since they hide
+ * the most.
+ */
+static void CullHiddenTiles(Terrain* terrain, vec3 position, int r)
+{
+    int count = terrain->visible_count;
+    terrain->hidden = 0;
+    terrain->unbounded = 0;
+    //From below, the terrain is back facing and hides nothing.
+    if(count == 0 || position[1] < Height(position[0], position[2])) return;
+    int i, j;
+    ReserveBounds(terrain, r);
+    int budget = BOUNDS_PER_FRAME;
+    for(i = 0; i < count; i++)
+    {
+        Tile* tile = terrain->visible + i;
+        if(budget > 0)
+            budget -= UpdateTileBounds(terrain, tile->x, tile->z);
+        else if(!HasTileBounds(terrain, tile->x, tile->z))
+            terrain->unbounded++;
+    }
+
+    int cells = TERRAIN_CELLS*TERRAIN_CELLS;
+    int size = TERRAIN_TILE_SIZE / TERRAIN_CELLS;
+    Occluder* occluders = terrain->occluders;
+    for(i = 0; i < count*cells; i++)
+    {
+        Tile* tile = terrain->visible + i / cells;
+        int u = tile->x*TERRAIN_CELLS + i % cells / TERRAIN_CELLS;
+        int v = tile->z*TERRAIN_CELLS + i % TERRAIN_CELLS;
+        Occluder* occluder = occluders + i;
+        occluder->min[1] = TERRAIN_MAX_HEIGHT;
+        for(j = 0; j < 4; j++)
+        {
+            occluder->min[1] = fminf(occluder->min[1],
+                                     GetCellGround(terrain, u + (j & 1),
+                                                   v + (j >> 1)));
+        }
+        occluder->min[0] = u*size;
+        occluder->min[2] = v*size;
+        occluder->max[0] = occluder->min[0] + 2*size;
+        occluder->max[1] = TERRAIN_MAX_HEIGHT;
+        occluder->max[2] = occluder->min[2] + 2*size;
+        float dx = fmaxf(fabsf(occluder->min[0] - position[0]),
+                         fabsf(occluder->max[0] - position[0]));
+        float dz = fmaxf(fabsf(occluder->min[2] - position[2]),
+                         fabsf(occluder->max[2] - position[2]));
+        occluder->farthest = sqrtf(dx*dx + dz*dz);
+    }
+    qsort(occluders, count*cells, sizeof(Occluder), CompareOccluders);
+
+    ClearHorizon(&terrain->horizon, position);
+    int k = 0, kept = 0;
+    for(i = 0; i < count; i++)
+    {
+        Tile tile = terrain->visible[i];
+        for(; k < count*cells && occluders[k].farthest <= tile.distance; k++)
+            RaiseHorizon(&terrain->horizon, occluders[k].min,
+                         occluders[k].max);
+        vec3 min = { tile.x*TERRAIN_TILE_SIZE, 0.f,
+                     tile.z*TERRAIN_TILE_SIZE };
+        vec3 max = { min[0] + TERRAIN_TILE_SIZE, 0.f,
+                     min[2] + TERRAIN_TILE_SIZE };
+        GetTileHeights(terrain, tile.x, tile.z, &min[1], &max[1]);
+        if(HorizonHides(&terrain->horizon, min, max)) continue;
+        terrain->visible[kept++] = tile;
+    }
+    terrain->hidden = count - kept;
+    terrain->visible_count = kept;
+}
+
+/*
+ * Finds the tiles within the view distance that intersect the view frustum
+ * and uploads their origins, nearest first.
+ */
+static void CullTiles(Terrain* terrain, vec3 position, Frustum* frustum,
+                      int cx, int cz, int r)
+{
+    int x, z;
+    terrain->visible_count = 0;
+    for(x = cx - r; x <= cx + r; x++)
+    {
+        for(z = cz - r; z <= cz + r; z++)
+        {
+            vec3 min = { x*TERRAIN_TILE_SIZE, TERRAIN_MIN_HEIGHT,
+                         z*TERRAIN_TILE_SIZE };
+            vec3 max = { min[0] + TERRAIN_TILE_SIZE, TERRAIN_MAX_HEIGHT,
+                         min[2] + TERRAIN_TILE_SIZE };
+            float dx = fmaxf(fmaxf(min[0] - position[0], 0.f),
+                             position[0] - max[0]);
+            float dz = fmaxf(fmaxf(min[2] - position[2], 0.f),
+                             position[2] - max[2]);
+            float distance = sqrtf(dx*dx + dz*dz);
+            if(distance > terrain->viewdistance) continue;
+            if(!BoxInFrustum(frustum, min, max)) continue;
+            Tile* tile = terrain->visible + terrain->visible_count++;
+            tile->x = x;
+            tile->z = z;
+            tile->distance = distance;
+        }
+    }
+    qsort(terrain->visible, terrain->visible_count, sizeof(Tile),
+          CompareTiles);
+    if(terrain->horizonculling) CullHiddenTiles(terrain, position, r);
+    if(terrain->path == TERRAIN_CACHED) return;
+
+    float* origins = terrain->scratch;
+    int i;
+    for(i = 0; i < terrain->visible_count; i++)
+    {
+        origins[2*i] = terrain->visible[i].x * TERRAIN_TILE_SIZE;
+        origins[2*i+1] = terrain->visible[i].z * TERRAIN_TILE_SIZE;
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, terrain->tile_buf);
+    glBufferData(GL_TEXTURE_BUFFER, terrain->capacity*2*sizeof(float), NULL,
+                 GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0,
+                    terrain->visible_count*2*sizeof(float), origins);
+}
+
+/*
+ * Uploads the bounds of every tile in the square around the camera tile.
+ * Only needed when the camera enters another tile or the view distance
+ * changes.
+ */
+static void UploadCandidates(Terrain* terrain, int cx, int cz, int r)
+{
+    int count = (2*r+1)*(2*r+1);
+    float* bounds = terrain->scratch;
+    float* b = bounds;
+    int x, z;
+    for(x = cx - r; x <= cx + r; x++)
+    {
+        for(z = cz - r; z <= cz + r; z++)
+        {
+            b[0] = x*TERRAIN_TILE_SIZE;
+            b[1] = TERRAIN_MIN_HEIGHT;
+            b[2] = z*TERRAIN_TILE_SIZE;
+            b[3] = 0.f;
+            b[4] = b[0] + TERRAIN_TILE_SIZE;
+            b[5] = TERRAIN_MAX_HEIGHT;
+            b[6] = b[2] + TERRAIN_TILE_SIZE;
+            b[7] = 0.f;
+            b += 8;
+        }
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, terrain->candidate_buf);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count*8*sizeof(float),
+                    bounds);
+    terrain->candidate_count = count;
+}
+
+/*
+ * Runs the culling shader over all candidate tiles. Survivors are appended
+ * to the tile buffer, counted in the instance count of the indirect
+ * command, so the CPU never sees which tiles are visible.
+ */
+static void CullTilesGPU(Terrain* terrain, RenderState* state,
+                         vec3 position, Frustum* frustum)
+{
+    DrawElementsIndirectCommand command = { terrain->icount, 0, 0, 0, 0 };
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, terrain->indirect_buf);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(command), &command);
+
+    UseProgram(state, terrain->cull_program);
+    glUniform4fv(terrain->cull_planes_loc, 6,
+                 (const float*)frustum->planes);
+    glUniform3fv(terrain->cull_camera_loc, 1, position);
+    glUniform1f(terrain->cull_viewdistance_loc, terrain->viewdistance);
+    glUniform1ui(terrain->cull_count_loc, terrain->candidate_count);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, terrain->candidate_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, terrain->indirect_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, terrain->tile_buf);
+    glDispatchCompute((terrain->candidate_count + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+/*
+ * Sizes the vertex cache to hold every tile within radius of the camera
+ * tile. Tiles keep their slot while the camera moves, so a tile is only
+ * captured again after it has left that square.
+ */
+static void ReserveCache(Terrain* terrain, int r)
+{
+    int width = 2*r+1;
+    if(width == terrain->cache_width) return;
+    int n = TERRAIN_TILE_SIZE + 1;
+    terrain->cache_width = width;
+    terrain->cached = realloc(terrain->cached,
+                              width*width*sizeof(CachedTile));
+    int i;
+    for(i = 0; i < width*width; i++) terrain->cached[i].valid = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, terrain->cache_buf);
+    glBufferData(GL_ARRAY_BUFFER, width*width*n*n*3*sizeof(float), NULL,
+                 GL_DYNAMIC_COPY);
+}
+
+/*
+ * Runs the noise shader once for each visible tile that isn't cached yet,
+ * capturing its displaced vertices into the tile's slot with transform
+ * feedback instead of drawing it.
+ */
+static void CaptureTiles(Terrain* terrain, RenderState* state)
+{
+    int n = TERRAIN_TILE_SIZE + 1;
+    GLsizeiptr size = n*n*3*sizeof(float);
+    int i;
+    terrain->captured = 0;
+    for(i = 0; i < terrain->visible_count; i++)
+    {
+        Tile* tile = terrain->visible + i;
+        int slot = WrapSlot(tile->x, tile->z, terrain->cache_width);
+        CachedTile* cached = terrain->cached + slot;
+        if(cached->valid && cached->x == tile->x && cached->z == tile->z)
+            continue;
+        if(terrain->captured++ == 0)
+        {
+            UseProgram(state, terrain->capture_program);
+            BindVertexArray(state, terrain->capture_vao);
+            glEnable(GL_RASTERIZER_DISCARD);
+        }
+        glUniform2f(terrain->capture_origin_loc, tile->x*TERRAIN_TILE_SIZE,
+                    tile->z*TERRAIN_TILE_SIZE);
+        glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, terrain->cache_buf,
+                          slot*size, size);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, n*n);
+        glEndTransformFeedback();
+        cached->x = tile->x;
+        cached->z = tile->z;
+        cached->valid = 1;
+    }
+    if(terrain->captured > 0) glDisable(GL_RASTERIZER_DISCARD);
+}
+
+/*
+ * Computes the height ranges of up to count tiles around position for
+ * horizon culling, nearest rings first, so they needn't be spread over the
+ * first frames. Meant for idle time while shaders build. Returns how many
+ * were computed, 0 once every tile within the view distance has them.
+ */
+int PrefetchTerrain(Terrain* terrain, vec3 position, int count)
+{
+    if(!terrain->horizonculling) return 0;
+    int r = TileRadius(terrain->viewdistance);
+    int cx = (int)floor(position[0] / TERRAIN_TILE_SIZE);
+    int cz = (int)floor(position[2] / TERRAIN_TILE_SIZE);
+    int done = 0, d, x, z;
+    ReserveBounds(terrain, r);
+    for(d = 0; d <= r && done < count; d++)
+    {
+        for(x = cx - d; x <= cx + d && done < count; x++)
+        {
+            //The ring is the first and last rows, and both ends of the
+            //rows in between.
+            int step = x == cx - d || x == cx + d ? 1 : 2*d;
+            for(z = cz - d; z <= cz + d && done < count; z += step)
+                done += UpdateTileBounds(terrain, x, z);
+        }
+    }
+    return done;
+}
+
+void UpdateTerrain(Terrain* terrain, RenderState* state, vec3 position,
+                   mat4x4 view_projection)
+{
+    Frustum frustum;
+    ExtractFrustum(&frustum, view_projection);
+    int r = TileRadius(terrain->viewdistance);
+    int cx = (int)floor(position[0] / TERRAIN_TILE_SIZE);
+    int cz = (int)floor(position[2] / TERRAIN_TILE_SIZE);
+    int i;
+    for(i = 0; i < 3; i++) terrain->position[i] = position[i];
+    if(terrain->path == TERRAIN_OCCLUSION_CULLED)
+        BeginOcclusionFrame(&terrain->occlusion, r, view_projection);
+    if(terrain->path == TERRAIN_CACHED)
+    {
+        ReserveCache(terrain, r);
+        CullTiles(terrain, position, &frustum, cx, cz, r);
+        CaptureTiles(terrain, state);
+        terrain->lookups += terrain->visible_count;
+        terrain->misses += terrain->captured;
+        return;
+    }
+    if(terrain->path == TERRAIN_BAKED)
+    {
+        r = ReserveTileCache(&terrain->heights, r);
+        CullTiles(terrain, position, &frustum, cx, cz, r);
+        for(i = 0; i < terrain->visible_count; i++)
+        {
+            RequestTile(&terrain->heights, terrain->visible[i].x,
+                        terrain->visible[i].z);
+        }
+        FlushTileCache(&terrain->heights, state);
+        terrain->lookups += terrain->visible_count;
+        terrain->misses += terrain->heights.generated;
+        return;
+    }
+    if(terrain->path != TERRAIN_GPU_CULLED)
+    {
+        CullTiles(terrain, position, &frustum, cx, cz, r);
+        return;
+    }
+    if(cx != terrain->center_x || cz != terrain->center_z ||
+       r != terrain->radius)
+    {
+        UploadCandidates(terrain, cx, cz, r);
+        terrain->center_x = cx;
+        terrain->center_z = cz;
+        terrain->radius = r;
+    }
+    CullTilesGPU(terrain, state, position, &frustum);
+}
+
+/*
+ * Records one draw per visible tile so each can be skipped on its own when
+ * its occlusion query found it hidden.
+ */
+static RenderCommand* SubmitTiles(Terrain* terrain, RenderQueue* queue,
+                                  GLuint program)
+{
+    RenderCommand* command = NULL;
+    GLint i;
+    for(i = 0; i < terrain->visible_count; i++)
+    {
+        Tile* tile = terrain->visible + i;
+        vec3 min = { tile->x*TERRAIN_TILE_SIZE, TERRAIN_MIN_HEIGHT,
+                     tile->z*TERRAIN_TILE_SIZE };
+        vec3 max = { min[0] + TERRAIN_TILE_SIZE, TERRAIN_MAX_HEIGHT,
+                     min[2] + TERRAIN_TILE_SIZE };
+        command = PushRenderCommand(queue, program, terrain->vao,
+                                    tile->distance);
+        if(!command) break;
+        command->count = terrain->icount;
+        command->condition = OcclusionCondition(&terrain->occlusion,
+                                                tile->x, tile->z, min, max,
+                                                terrain->position);
+        if(PushRenderUniform(queue, UNIFORM_INT, terrain->tile_base_loc,
+                             &i) < 0)
+            return NULL;
+    }
+    return command;
+}
+
+//Records one draw per visible tile from its slot of the vertex cache.
+static RenderCommand* SubmitCached(Terrain* terrain, RenderQueue* queue,
+                                   GLuint program)
+{
+    int n = TERRAIN_TILE_SIZE + 1;
+    RenderCommand* command = NULL;
+    int i;
+    for(i = 0; i < terrain->visible_count; i++)
+    {
+        Tile* tile = terrain->visible + i;
+        command = PushRenderCommand(queue, program, terrain->vao,
+                                    tile->distance);
+        if(!command) break;
+        command->count = terrain->icount;
+        command->base_vertex = WrapSlot(tile->x, tile->z,
+                                        terrain->cache_width)*n*n;
+    }
+    return command;
+}
+
+//Records one draw per visible tile with its layer of the height cache.
+static RenderCommand* SubmitBaked(Terrain* terrain, RenderQueue* queue,
+                                  GLuint program)
+{
+    RenderCommand* command = NULL;
+    GLint i;
+    for(i = 0; i < terrain->visible_count; i++)
+    {
+        Tile* tile = terrain->visible + i;
+        GLint layer = TileLayer(&terrain->heights, tile->x, tile->z);
+        command = PushRenderCommand(queue, program, terrain->vao,
+                                    tile->distance);
+        if(!command) break;
+        command->count = terrain->icount;
+        if(PushRenderUniform(queue, UNIFORM_INT, terrain->tile_base_loc,
+                             &i) < 0 ||
+           PushRenderUniform(queue, UNIFORM_INT, terrain->layer_loc,
+                             &layer) < 0)
+            return NULL;
+    }
+    return command;
+}
+
+RenderCommand* SubmitTerrain(Terrain* terrain, RenderQueue* queue,
+                             GLuint program)
+{
+    if(terrain->path == TERRAIN_GPU_CULLED ? terrain->candidate_count == 0 :
+                                             terrain->visible_count == 0)
+        return NULL;
+    if(terrain->path == TERRAIN_CACHED)
+        return SubmitCached(terrain, queue, program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, terrain->tile_tex);
+    if(terrain->path == TERRAIN_OCCLUSION_CULLED)
+        return SubmitTiles(terrain, queue, program);
+    if(terrain->path == TERRAIN_BAKED)
+    {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, terrain->heights.texture);
+        glActiveTexture(GL_TEXTURE0);
+        return SubmitBaked(terrain, queue, program);
+    }
+    RenderCommand* command = PushRenderCommand(queue, program, terrain->vao,
+                                               0.f);
+    if(!command) return NULL;
+    command->count = terrain->icount;
+    if(terrain->path == TERRAIN_GPU_CULLED)
+    {
+        command->indirect = terrain->indirect_buf;
+        command->draws = 1;
+    }
+    else if(terrain->path == TERRAIN_MULTIDRAW)
+    {
+        command->indirect = terrain->indirect_buf;
+        command->draws = terrain->visible_count;
+    }
+    else
+    {
+        command->instances = terrain->visible_count;
+    }
+    return command;
+}
+
+/*
+ * Issues the occlusion queries for the next frames. Must be called after
+ * the terrain has been drawn.
+ */
+void TestTerrainOcclusion(Terrain* terrain, RenderState* state,
+                          mat4x4 view_projection)
+{
+    if(terrain->path != TERRAIN_OCCLUSION_CULLED) return;
+    TestOcclusion(&terrain->occlusion, state, view_projection);
+}
+
+static int CountValid(CachedTile* tiles, int count)
+{
+    int i, valid = 0;
+    for(i = 0; i < count; i++) valid += tiles[i].valid;
+    return valid;
+}
+
+void GetTerrainStats(Terrain* terrain, TerrainStats* stats)
+{
+    int n = TERRAIN_TILE_SIZE + 1;
+    stats->tiles = terrain->path == TERRAIN_GPU_CULLED ?
+                   terrain->candidate_count : terrain->visible_count;
+    stats->resident = -1;
+    stats->pending = 0;
+    stats->hit_rate = -1.;
+    stats->cache_bytes = -1.;
+    stats->generate_time = -1.;
+    if(terrain->path == TERRAIN_CACHED)
+    {
+        int slots = terrain->cache_width*terrain->cache_width;
+        stats->resident = CountValid(terrain->cached, slots);
+        stats->pending = terrain->captured;
+        stats->cache_bytes = (double)slots*n*n*3*sizeof(float);
+    }
+    else if(terrain->path == TERRAIN_BAKED)
+    {
+        int slots = terrain->heights.width*terrain->heights.width;
+        stats->resident = CountValid(terrain->heights.tiles, slots);
+        stats->pending = terrain->heights.generated;
+        stats->cache_bytes = (double)slots*n*n*sizeof(float);
+        stats->generate_time = terrain->heights.generate_time;
+    }
+    if(stats->resident >= 0 && terrain->lookups > 0)
+    {
+        stats->hit_rate = 1. - terrain->misses / (double)terrain->lookups;
+    }
+}
+
+/*
+ * Tells if the last frame drawn rests on work that later frames finish on
+ * their own, so drawing should go on even if the camera stays still.
+ * Occlusion results from before the view last changed may hide tiles that
+ * are visible now, and tiles without height ranges yet hide less of the
+ * terrain behind them than they will.
+ */
+int TerrainPending(Terrain* terrain)
+{
+    if(terrain->horizonculling && terrain->unbounded > 0) return 1;
+    return terrain->path == TERRAIN_OCCLUSION_CULLED &&
+           terrain->occlusion.unsettled > 0;
+}
+
+void DestroyTerrain(Terrain* terrain)
+{
+    FinishProgram(&terrain->build, NULL);
+    if(terrain->path == TERRAIN_OCCLUSION_CULLED)
+        DestroyOcclusion(&terrain->occlusion);
+    glDeleteVertexArrays(1, &terrain->vao);
+    glDeleteBuffers(1, &terrain->vbuf);
+    glDeleteBuffers(1, &terrain->ibuf);
+    glDeleteTextures(1, &terrain->tile_tex);
+    glDeleteBuffers(1, &terrain->tile_buf);
+    glDeleteBuffers(1, &terrain->indirect_buf);
+    glDeleteBuffers(1, &terrain->candidate_buf);
+    if(terrain->cull_program) glDeleteProgram(terrain->cull_program);
+    if(terrain->path == TERRAIN_CACHED)
+    {
+        glDeleteProgram(terrain->capture_program);
+        glDeleteVertexArrays(1, &terrain->capture_vao);
+        glDeleteBuffers(1, &terrain->cache_buf);
+    }
+    if(terrain->path == TERRAIN_BAKED) DestroyTileCache(&terrain->heights);
+    free(terrain->cached);
+    free(terrain->visible);
+    free(terrain->scratch);
+    free(terrain->bounds);
+    free(terrain->occluders);
+}
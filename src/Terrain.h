@@ -0,0 +1,144 @@
+#ifndef TERRAIN_H_
+#define TERRAIN_H_
+
+#include <glad/glad.h>
+#include <linmath.h>
+#include "Render.h"
+#include "Occlusion.h"
+#include "Horizon.h"
+#include "TileCache.h"
+#include "Shaders.h"
+
+#define TERRAIN_TILE_SIZE 32 //Quads along a tile side
+#define TERRAIN_MIN_HEIGHT 0.f
+#define TERRAIN_MAX_HEIGHT 20.f
+#define TERRAIN_CELLS 4 //Ground heights along a tile side for horizon culling
+
+/*
+ * How the visible tiles are found and drawn. All paths submit the tiles in
+ * one call and fetch the tile origin from a buffer texture, indexed by
+ * gl_DrawIDARB for multi-draw-indirect and by gl_InstanceID otherwise. The
+ * GPU culled path runs the frustum and view distance tests in a compute
+ * shader that writes the instance count of an indirect draw. The occlusion
+ * culled path draws tiles one by one, each conditional on a hardware
+ * occlusion query of its bounding box from an earlier frame. The cached
+ * path runs the noise once per tile as it comes into view, capturing the
+ * displaced vertices with transform feedback, and draws them one tile at a
+ * time with a pass-through shader. The baked path does the same with tile
+ * heights in a texture array, generated by a compute shader or the CPU.
+ */
+typedef enum
+{
+    TERRAIN_INSTANCED,
+    TERRAIN_MULTIDRAW,
+    TERRAIN_GPU_CULLED,
+    TERRAIN_OCCLUSION_CULLED,
+    TERRAIN_CACHED,
+    TERRAIN_BAKED
+} TerrainPath;
+
+typedef struct
+{
+    int x, z;
+    float distance;
+} Tile;
+
+/*
+ * Height range of a tile and the lowest ground in each of its cells, cached
+ * in a table that wraps around like the occlusion table.
+ */
+typedef struct
+{
+    int x, z;
+    float min, max;
+    float ground[TERRAIN_CELLS*TERRAIN_CELLS];
+    char valid;
+} TileBounds;
+
+//Box around the lowest ground of a few cells, hiding what is behind it.
+typedef struct
+{
+    vec3 min, max;
+    float farthest;
+} Occluder;
+
+/*
+ * Counts for the HUD. tiles is the number of tiles drawn, or considered by
+ * the culling shader on the GPU culled path. Where tiles are cached,
+ * pending is the number generated this frame, and hit_rate the share of
+ * drawn tiles found in the cache since the start. Otherwise resident,
+ * hit_rate and cache_bytes are negative. generate_time is the CPU time
+ * spent generating tiles on the baked path this frame, negative elsewhere.
+ */
+typedef struct
+{
+    int tiles, resident, pending;
+    double hit_rate;
+    double cache_bytes;
+    double generate_time;
+} TerrainStats;
+
+typedef struct
+{
+    GLuint vbuf, ibuf, vao;
+    GLint tile_base_loc;
+    GLuint tile_buf, tile_tex;
+    GLuint indirect_buf;
+    GLuint candidate_buf;
+    GLuint cull_program;
+    GLint cull_planes_loc, cull_camera_loc;
+    GLint cull_viewdistance_loc, cull_count_loc;
+    int center_x, center_z, radius;
+    int candidate_count;
+    GLuint capture_program, capture_vao;
+    GLint capture_origin_loc;
+    GLuint cache_buf;
+    CachedTile* cached;
+    int cache_width;
+    int captured;
+    long lookups, misses;
+    TileCache heights;
+    GLint layer_loc;
+    Occlusion occlusion;
+    char horizonculling;
+    Horizon horizon;
+    TileBounds* bounds;
+    int bounds_width;
+    Occluder* occluders;
+    int unbounded; //Visible tiles still without height ranges
+    int hidden;
+    vec3 position;
+    int icount;
+    float viewdistance;
+    TerrainPath path;
+    Tile* visible;
+    int visible_count, capacity;
+    float* scratch; //Tile origins or bounds to upload, 8 floats per tile
+    ProgramBuild build; //Shader of the path, until FinishTerrain
+} Terrain;
+
+GLuint CreateGridVertexBuffer(int n, int step);
+GLuint CreateGridIndexBuffer(int* count, int n);
+void ConstructTerrain(Terrain* terrain, float viewdistance, TerrainPath path,
+                      GeneratorBackend generator, char horizonculling);
+void FinishTerrain(Terrain* terrain);
+void SetTerrainProgram(Terrain* terrain, GLuint program);
+float MaxTerrainViewDistance(TerrainPath path);
+GLsizei GetTerrainHeightSources(Terrain* terrain, ShaderSource* sources,
+                                GLsizei* varying_count,
+                                const char*** varyings);
+void SetTerrainHeightProgram(Terrain* terrain, RenderState* state,
+                             GLuint program);
+void SetTerrainViewDistance(Terrain* terrain, float viewdistance);
+int PrefetchTerrain(Terrain* terrain, vec3 position, int count);
+void UpdateTerrain(Terrain* terrain, RenderState* state, vec3 position,
+                   mat4x4 view_projection);
+RenderCommand* SubmitTerrain(Terrain* terrain, RenderQueue* queue,
+                             GLuint program);
+void TestTerrainOcclusion(Terrain* terrain, RenderState* state,
+                          mat4x4 view_projection);
+void GetTerrainStats(Terrain* terrain, TerrainStats* stats);
+int TerrainPending(Terrain* terrain);
+void DestroyTerrain(Terrain* terrain);
+
+#endif
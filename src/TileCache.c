@@ -0,0 +1,129 @@
+#include "TileCache.h"
+#include "Terrain.h"
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+
+/*
+ * Sets up an empty cache filled by the given backend. Returns a negative
+ * value if the backend isn't supported.
+ */
+int ConstructTileCache(TileCache* cache, GeneratorBackend backend)
+{
+    if(ConstructTileGenerator(&cache->generator, backend) < 0) return -1;
+    glGenTextures(1, &cache->texture);
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &cache->max_layers);
+    cache->tiles = NULL;
+    cache->width = 0;
+    cache->requests = NULL;
+    cache->request_count = 0;
+    cache->generated = 0;
+    cache->generate_time = 0.0;
+    return 0;
+}
+
+//Gets the largest radius a cache can hold on this driver.
+int MaxTileCacheRadius(void)
+{
+    GLint layers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &layers);
+    int radius = 0;
+    while((2*radius+3)*(2*radius+3) <= layers) radius++;
+    return radius;
+}
+
+/*
+ * Sizes the cache to hold every tile within radius of the camera tile.
+ * Returns the radius actually covered, which is smaller if the texture
+ * array can't have that many layers.
+ */
+int ReserveTileCache(TileCache* cache, int radius)
+{
+    while(radius > 0 && (2*radius+1)*(2*radius+1) > cache->max_layers)
+        radius--;
+    int width = 2*radius+1;
+    if(width == cache->width) return radius;
+    int n = TERRAIN_TILE_SIZE + 1;
+    cache->width = width;
+    cache->tiles = realloc(cache->tiles, width*width*sizeof(CachedTile));
+    cache->requests = realloc(cache->requests,
+                              width*width*sizeof(TileRequest));
+    cache->request_count = 0;
+    int i;
+    for(i = 0; i < width*width; i++) cache->tiles[i].valid = 0;
+
+    //Immutable storage can't be resized, so use a new texture.
+    glDeleteTextures(1, &cache->texture);
+    glGenTextures(1, &cache->texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cache->texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    if(GLAD_GL_VERSION_4_2)
+    {
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32F, n, n, width*width);
+    }
+    else
+    {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32F, n, n, width*width, 0,
+                     GL_RED, GL_FLOAT, NULL);
+    }
+    return radius;
+}
+
+/*
+ * Gets the layer a tile goes in. Only tiles within the reserved radius of
+ * the camera tile have layers of their own.
+ */
+int TileLayer(TileCache* cache, int x, int z)
+{
+    int wx = x % cache->width, wz = z % cache->width;
+    return (wx < 0 ? wx + cache->width : wx)*cache->width +
+           (wz < 0 ? wz + cache->width : wz);
+}
+
+//Makes every tile be generated again when next requested.
+void ClearTileCache(TileCache* cache)
+{
+    int i;
+    for(i = 0; i < cache->width*cache->width; i++) cache->tiles[i].valid = 0;
+}
+
+//Returns the layer of a tile, queueing it for generation if it isn't there.
+int RequestTile(TileCache* cache, int x, int z)
+{
+    int layer = TileLayer(cache, x, z);
+    CachedTile* tile = cache->tiles + layer;
+    if(!tile->valid || tile->x != x || tile->z != z)
+    {
+        TileRequest* request = cache->requests + cache->request_count++;
+        request->x = x;
+        request->z = z;
+        request->layer = layer;
+        tile->x = x;
+        tile->z = z;
+        tile->valid = 1;
+    }
+    return layer;
+}
+
+//Generates the queued tiles, timing how long it takes on the CPU.
+void FlushTileCache(TileCache* cache, RenderState* state)
+{
+    cache->generated = cache->request_count;
+    cache->generate_time = 0.0;
+    if(cache->request_count == 0) return;
+    Uint64 start = SDL_GetPerformanceCounter();
+    GenerateTiles(&cache->generator, state, cache->texture, cache->requests,
+                  cache->request_count);
+    cache->generate_time = (SDL_GetPerformanceCounter() - start) /
+                           (double)SDL_GetPerformanceFrequency();
+    cache->request_count = 0;
+}
+
+void DestroyTileCache(TileCache* cache)
+{
+    DestroyTileGenerator(&cache->generator);
+    glDeleteTextures(1, &cache->texture);
+    free(cache->tiles);
+    free(cache->requests);
+}
@@ -0,0 +1,44 @@
+#ifndef TILECACHE_H_
+#define TILECACHE_H_
+
+#include <glad/glad.h>
+#include "Render.h"
+#include "TileGenerator.h"
+
+//Tile whose data is in a slot of a cache.
+typedef struct
+{
+    int x, z;
+    char valid;
+} CachedTile;
+
+/*
+ * Heights of the tiles around the camera, one tile per layer of a texture
+ * array. Slots wrap around in both directions, so tiles keep their layer
+ * while the camera moves and are only generated again after leaving the
+ * square the cache covers. Missing tiles are queued by RequestTile and
+ * generated together by FlushTileCache.
+ */
+typedef struct
+{
+    TileGenerator generator;
+    GLuint texture;
+    CachedTile* tiles;
+    int width;
+    GLint max_layers;
+    TileRequest* requests;
+    int request_count;
+    int generated;        //Tiles generated by the last flush
+    double generate_time; //Seconds the last flush took on the CPU
+} TileCache;
+
+int ConstructTileCache(TileCache* cache, GeneratorBackend backend);
+int MaxTileCacheRadius(void);
+int ReserveTileCache(TileCache* cache, int radius);
+int TileLayer(TileCache* cache, int x, int z);
+void ClearTileCache(TileCache* cache);
+int RequestTile(TileCache* cache, int x, int z);
+void FlushTileCache(TileCache* cache, RenderState* state);
+void DestroyTileCache(TileCache* cache);
+
+#endif
@@ -0,0 +1,153 @@
+#include "TileGenerator.h"
+#include "Terrain.h"
+#include "Noise.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+#define BAKE_BATCH 64 //Tiles per compute dispatch
+#define BAKE_GROUP 8 //Work group side, in texels
+
+/*
+ * Gets the sources of the compute program, which stay valid with the
+ * generator. Returns how many there are, 0 for the CPU backend.
+ */
+GLsizei GetTileGeneratorSources(TileGenerator* generator,
+                                ShaderSource* sources)
+{
+    if(generator->backend != GENERATOR_GPU) return 0;
+    sources[0] = (ShaderSource){ GL_COMPUTE_SHADER, "Noise.glsl",
+                                 generator->defines };
+    sources[1] = (ShaderSource){ GL_COMPUTE_SHADER, "HeightBake.glsl",
+                                 generator->defines };
+    return 2;
+}
+
+static void StartBakeProgram(TileGenerator* generator)
+{
+    snprintf(generator->defines, sizeof(generator->defines),
+             "#version 430\n#define TILE_SIZE %d\n#define BAKE_BATCH %d\n"
+             "#define BAKE_GROUP %d\n", TERRAIN_TILE_SIZE, BAKE_BATCH,
+             BAKE_GROUP);
+    ShaderSource sources[2];
+    GetTileGeneratorSources(generator, sources);
+    StartProgram(&generator->build, 2, sources, 0, NULL);
+}
+
+//Replaces the compute program with one rebuilt from the same sources.
+void SetTileGeneratorProgram(TileGenerator* generator, RenderState* state,
+                             GLuint program)
+{
+    ForgetProgram(state, generator->program);
+    glDeleteProgram(generator->program);
+    generator->program = program;
+    generator->requests_loc = glGetUniformLocation(program, "requests");
+}
+
+/*
+ * Sets up a generator. The GPU backend needs compute shaders, so it fails
+ * with GL versions before 4.3. Otherwise its program is built until
+ * FinishTileGenerator.
+ */
+int ConstructTileGenerator(TileGenerator* generator, GeneratorBackend backend)
+{
+    int n = TERRAIN_TILE_SIZE + 1;
+    generator->backend = backend;
+    generator->program = 0;
+    generator->build.program = 0;
+    generator->build.count = 0;
+    generator->defines[0] = 0;
+    generator->heights = NULL;
+    if(backend == GENERATOR_GPU)
+    {
+        if(!GLAD_GL_VERSION_4_3) return -1;
+        StartBakeProgram(generator);
+    }
+    else generator->heights = malloc(n*n*sizeof(float));
+    return 0;
+}
+
+//Waits for the compute program. Returns a negative value if it failed.
+int FinishTileGenerator(TileGenerator* generator)
+{
+    if(generator->backend != GENERATOR_GPU) return 0;
+    if(FinishProgram(&generator->build, &generator->program) < 0) return -1;
+    generator->requests_loc = glGetUniformLocation(generator->program,
+                                                   "requests");
+    return 0;
+}
+
+static void GenerateTilesCPU(TileGenerator* generator, GLuint texture,
+                             const TileRequest* requests, int count)
+{
+    int n = TERRAIN_TILE_SIZE + 1;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    int t, i, j;
+    for(t = 0; t < count; t++)
+    {
+        float x = requests[t].x*TERRAIN_TILE_SIZE;
+        float z = requests[t].z*TERRAIN_TILE_SIZE;
+        for(j = 0; j < n; j++)
+        {
+            float* row = generator->heights + j*n;
+            for(i = 0; i + 4 <= n; i += 4)
+            {
+                float xs[4] = { x + i, x + i + 1, x + i + 2, x + i + 3 };
+                float zs[4] = { z + j, z + j, z + j, z + j };
+                Height4(xs, zs, row + i);
+            }
+            for(; i < n; i++) row[i] = Height(x + i, z + j);
+        }
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, requests[t].layer,
+                        n, n, 1, GL_RED, GL_FLOAT, generator->heights);
+    }
+}
+
+/*
+ * Each dispatch covers a batch of tiles, one layer of work groups per
+ * tile. The heights are read by vertex shaders through texelFetch, hence
+ * the texture fetch barrier.
+ */
+static void GenerateTilesGPU(TileGenerator* generator, RenderState* state,
+                             GLuint texture, const TileRequest* requests,
+                             int count)
+{
+    int n = TERRAIN_TILE_SIZE + 1;
+    int groups = (n + BAKE_GROUP - 1) / BAKE_GROUP;
+    GLint batch[3*BAKE_BATCH];
+    UseProgram(state, generator->program);
+    glBindImageTexture(0, texture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32F);
+    int first, i;
+    for(first = 0; first < count; first += BAKE_BATCH)
+    {
+        int size = count - first < BAKE_BATCH ? count - first : BAKE_BATCH;
+        for(i = 0; i < size; i++)
+        {
+            batch[3*i] = requests[first + i].x;
+            batch[3*i+1] = requests[first + i].z;
+            batch[3*i+2] = requests[first + i].layer;
+        }
+        glUniform3iv(generator->requests_loc, size, batch);
+        glDispatchCompute(groups, groups, size);
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+/*
+ * Writes the heights of the requested tiles into their layers of texture,
+ * a single channel float array with one texel per tile vertex.
+ */
+void GenerateTiles(TileGenerator* generator, RenderState* state,
+                   GLuint texture, const TileRequest* requests, int count)
+{
+    if(count == 0) return;
+    if(generator->backend == GENERATOR_GPU)
+        GenerateTilesGPU(generator, state, texture, requests, count);
+    else GenerateTilesCPU(generator, texture, requests, count);
+}
+
+void DestroyTileGenerator(TileGenerator* generator)
+{
+    FinishProgram(&generator->build, NULL);
+    if(generator->program) glDeleteProgram(generator->program);
+    free(generator->heights);
+}
@@ -0,0 +1,45 @@
+#ifndef TILEGENERATOR_H_
+#define TILEGENERATOR_H_
+
+#include <glad/glad.h>
+#include "Render.h"
+#include "Shaders.h"
+
+/*
+ * Where tile heights are computed. The CPU backend evaluates the noise in C
+ * and uploads the result, the GPU backend runs it in a compute shader
+ * writing straight to the texture, many tiles per dispatch.
+ */
+typedef enum
+{
+    GENERATOR_GPU,
+    GENERATOR_CPU
+} GeneratorBackend;
+
+//Tile to generate, in tiles from the world origin, and its texture layer.
+typedef struct
+{
+    int x, z, layer;
+} TileRequest;
+
+typedef struct
+{
+    GeneratorBackend backend;
+    GLuint program;
+    GLint requests_loc;
+    char defines[128]; //Inserted into the compute shaders
+    ProgramBuild build; //Until FinishTileGenerator
+    float* heights;
+} TileGenerator;
+
+int ConstructTileGenerator(TileGenerator* generator, GeneratorBackend backend);
+int FinishTileGenerator(TileGenerator* generator);
+GLsizei GetTileGeneratorSources(TileGenerator* generator,
+                                ShaderSource* sources);
+void SetTileGeneratorProgram(TileGenerator* generator, RenderState* state,
+                             GLuint program);
+void GenerateTiles(TileGenerator* generator, RenderState* state,
+                   GLuint texture, const TileRequest* requests, int count);
+void DestroyTileGenerator(TileGenerator* generator);
+
+#endif
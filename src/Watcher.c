@@ -0,0 +1,97 @@
+#include "Watcher.h"
+#include <string.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+static time_t ModificationTime(const char* file)
+{
+    struct stat s;
+    return stat(file, &s) == 0 ? s.st_mtime : 0;
+}
+
+void ConstructWatcher(Watcher* watcher)
+{
+    watcher->fd = -1;
+    watcher->file_count = 0;
+    watcher->checked = SDL_GetTicks();
+#ifdef __linux__
+    watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watcher->fd >= 0 &&
+       inotify_add_watch(watcher->fd, ".", IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        close(watcher->fd);
+        watcher->fd = -1;
+    }
+#endif
+}
+
+/*
+ * Starts watching a file, named relative to the working directory without
+ * any directories. The name must stay valid while watched. Returns the bit
+ * PollWatcher sets for it, the same one if it is already watched, or 0 if
+ * too many files are watched.
+ */
+unsigned int WatchFile(Watcher* watcher, const char* file)
+{
+    int i;
+    for(i = 0; i < watcher->file_count; i++)
+        if(strcmp(watcher->files[i], file) == 0) return 1 << i;
+    if(watcher->file_count == WATCHER_FILES) return 0;
+    watcher->files[watcher->file_count] = file;
+    watcher->mtimes[watcher->file_count] = ModificationTime(file);
+    return 1 << watcher->file_count++;
+}
+
+//Gets the bits of the files written since the last poll.
+unsigned int PollWatcher(Watcher* watcher)
+{
+    unsigned int changed = 0;
+    int i;
+#ifdef __linux__
+    if(watcher->fd >= 0)
+    {
+        char buffer[4096]
+            __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t length;
+        while((length = read(watcher->fd, buffer, sizeof(buffer))) > 0)
+        {
+            char* p = buffer;
+            while(p < buffer + length)
+            {
+                struct inotify_event* event = (struct inotify_event*)p;
+                for(i = 0; event->len > 0 && i < watcher->file_count; i++)
+                {
+                    if(strcmp(event->name, watcher->files[i]) == 0)
+                        changed |= 1 << i;
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        return changed;
+    }
+#endif
+    Uint32 now = SDL_GetTicks();
+    if(now - watcher->checked < WATCHER_INTERVAL) return 0;
+    watcher->checked = now;
+    for(i = 0; i < watcher->file_count; i++)
+    {
+        time_t mtime = ModificationTime(watcher->files[i]);
+        if(mtime != watcher->mtimes[i])
+        {
+            watcher->mtimes[i] = mtime;
+            changed |= 1 << i;
+        }
+    }
+    return changed;
+}
+
+void DestroyWatcher(Watcher* watcher)
+{
+#ifdef __linux__
+    if(watcher->fd >= 0) close(watcher->fd);
+#endif
+    watcher->fd = -1;
+}
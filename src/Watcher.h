@@ -0,0 +1,30 @@
+#ifndef WATCHER_H_
+#define WATCHER_H_
+
+#include <SDL2/SDL.h>
+#include <time.h>
+
+#define WATCHER_FILES 8      //Most files watched
+#define WATCHER_INTERVAL 250 //ms between checks without inotify
+
+/*
+ * Notices when files in the working directory are written. On Linux the
+ * directory is watched with inotify, so editors that save by renaming a new
+ * file over the old one are noticed too. Elsewhere the modification times
+ * are checked every WATCHER_INTERVAL. Polling never blocks.
+ */
+typedef struct
+{
+    int fd; //inotify instance, -1 when modification times are checked
+    const char* files[WATCHER_FILES];
+    time_t mtimes[WATCHER_FILES];
+    int file_count;
+    Uint32 checked;
+} Watcher;
+
+void ConstructWatcher(Watcher* watcher);
+unsigned int WatchFile(Watcher* watcher, const char* file);
+unsigned int PollWatcher(Watcher* watcher);
+void DestroyWatcher(Watcher* watcher);
+
+#endif
@@ -1,157 +1,640 @@
 #include "PT.h"
 #include <stdio.h>
+#include <string.h>
 
 typedef enum
 {
     STATE_RUNNING = 1,
     STATE_FULLSCREEN = 1 << 1,
-    STATE_MOUSE_GRABBED = 1 << 2
+    STATE_MOUSE_GRABBED = 1 << 2,
+    STATE_IDLE = 1 << 3
 } State;
 
+#define IDLE_TIMEOUT 250 //ms
+#define IMPOSTOR_SIZE 1024 //Pixels along a panorama face side
 
-static int SetupProgram(GLuint* dst)
+//Uniform locations of the terrain program.
+typedef struct
 {
-    GLuint program;
-    GLuint shaders[3];
-    if(LoadShader(shaders, GL_VERTEX_SHADER, "Noise.glsl") < 0) return -1;
-    if(LoadShader(shaders + 1, GL_VERTEX_SHADER, "TerrainVertex.glsl") < 0)
+    GLint world_mat, view_mat, proj_mat;
+    GLint color, viewdistance, tiles, heights;
+} GridUniforms;
+
+static void StartTerrainProgram(ProgramBuild* build, const char* vertex,
+                                const char* defines)
+{
+    const ShaderSource sources[] = {
+        { GL_VERTEX_SHADER, "Noise.glsl", NULL },
+        { GL_VERTEX_SHADER, vertex, defines },
+        { GL_FRAGMENT_SHADER, "Fragment.glsl", NULL }
+    };
+    StartProgram(build, 3, sources, 0, NULL);
+}
+
+/*
+ * Draws the terrain with a program, and sets the uniforms that don't change
+ * every frame.
+ */
+static void UseGridProgram(Terrain* terrain, RenderState* state,
+                           GLuint program, GridUniforms* grid,
+                           const vec3 color, float fogdistance,
+                           mat4x4 projection)
+{
+    SetTerrainProgram(terrain, program);
+    grid->world_mat = glGetUniformLocation(program, "world_mat");
+    grid->view_mat = glGetUniformLocation(program, "view_mat");
+    grid->proj_mat = glGetUniformLocation(program, "proj_mat");
+    grid->color = glGetUniformLocation(program, "color");
+    grid->viewdistance = glGetUniformLocation(program, "viewdistance");
+    grid->tiles = glGetUniformLocation(program, "tiles");
+    grid->heights = glGetUniformLocation(program, "heights");
+    GLint tiles_unit = 0;
+    GLint heights_unit = 1;
+    SetUniform(state, program, UNIFORM_VEC3, grid->color, color);
+    SetUniform(state, program, UNIFORM_FLOAT, grid->viewdistance,
+               &fogdistance);
+    SetUniform(state, program, UNIFORM_INT, grid->tiles, &tiles_unit);
+    SetUniform(state, program, UNIFORM_INT, grid->heights, &heights_unit);
+    SetUniform(state, program, UNIFORM_MAT4, grid->proj_mat, projection);
+}
+
+//Gets the vertex shader and extra lines the terrain is drawn with on a path.
+static void GetTerrainShader(TerrainPath path, const char** vertex,
+                             const char** defines)
+{
+    *vertex = "TerrainVertex.glsl";
+    *defines = NULL;
+    if(path == TERRAIN_CACHED)
     {
-        glDeleteShader(shaders[0]);
-        return -2;
+        *vertex = "CachedVertex.glsl";
     }
-    if(LoadShader(shaders + 2, GL_FRAGMENT_SHADER, "Fragment.glsl") < 0)
+    else if(path == TERRAIN_BAKED)
     {
-        glDeleteShader(shaders[0]);
-        glDeleteShader(shaders[1]);
-        return -3;
+        *vertex = "BakedVertex.glsl";
+    }
+    else if(path == TERRAIN_MULTIDRAW)
+    {
+        *defines = "#extension GL_ARB_shader_draw_parameters : require\n"
+                   "#define TERRAIN_DRAW_ID\n";
     }
-    int err = CreateProgram(&program, 3, shaders);
-    glDeleteShader(shaders[0]);
-    glDeleteShader(shaders[1]);
-    glDeleteShader(shaders[2]);
-    if(err < 0) return -3;
-    *dst = program;
-    return 0;
 }
 
-static GLuint CreateGridVertexBuffer(float vd)
+//Keeps a setting that only applies at startup, noting if the file changed.
+#define KEEP_SETTING(updated, settings, file, field) \
+    if((updated)->field != (settings)->field) \
+    { \
+        if((updated)->field != (file)->field) \
+            Log(LOG_INFO, "Changing " #field " takes effect after a " \
+                          "restart."); \
+        (updated)->field = (settings)->field; \
+    }
+
+/*
+ * Reads settings.ini again, given what it held last time. Settings used
+ * only while starting up keep their values, so the caller can apply the
+ * rest by comparing with the old ones.
+ */
+static void ReloadSettings(Settings* settings, Settings* file)
 {
-    int n = 2*(int)ceil(vd);
-    float co = -n/2.f; //Center offset
-    size_t vs_size = n*n*2*sizeof(float);
-    GLuint buf;
-    glGenBuffers(1, &buf);
-    glBindBuffer(GL_ARRAY_BUFFER, buf);
-    glBufferData(GL_ARRAY_BUFFER, vs_size, NULL, GL_STATIC_DRAW);
-    float* vs = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-    int i, j, front = 0;
-    for(i = 0; i < n; i++)
+    Settings updated;
+    ConstructSettings(&updated);
+    LoadSettingsFile(&updated, "settings.ini");
+    Settings read = updated;
+    updated.video.headless = settings->video.headless;
+    if(updated.video.headless)
     {
-        for(j = 0; j < n; j++)
-        {
-            vs[front++] = i + co;
-            vs[front++] = j + co;
-        }
+        updated.video.idle = 0;
+        KEEP_SETTING(&updated, settings, file, video.width);
+        KEEP_SETTING(&updated, settings, file, video.height);
     }
-    glUnmapBuffer(GL_ARRAY_BUFFER);
-    return buf;
+    KEEP_SETTING(&updated, settings, file, graphics.multidraw);
+    KEEP_SETTING(&updated, settings, file, graphics.gpuculling);
+    KEEP_SETTING(&updated, settings, file, graphics.occlusionculling);
+    KEEP_SETTING(&updated, settings, file, graphics.horizonculling);
+    KEEP_SETTING(&updated, settings, file, graphics.tilecache);
+    KEEP_SETTING(&updated, settings, file, graphics.tilebaking);
+    KEEP_SETTING(&updated, settings, file, graphics.tilegenerator);
+    KEEP_SETTING(&updated, settings, file, graphics.farviewdistance);
+    KEEP_SETTING(&updated, settings, file, graphics.impostormove);
+    KEEP_SETTING(&updated, settings, file, graphics.impostorerror);
+    KEEP_SETTING(&updated, settings, file, graphics.programcache);
+    KEEP_SETTING(&updated, settings, file, capture.png);
+    KEEP_SETTING(&updated, settings, file, capture.fps);
+    *settings = updated;
+    *file = read;
 }
 
-static GLuint CreateGridIndexBuffer(int* count, float vd)
+/*
+ * Keeps the view distance settings within what the terrain path can draw,
+ * so fog and the governor match the tiles drawn. Returns 1 if any changed.
+ */
+static int LimitViewDistance(Settings* settings, float limit)
 {
-    int n = 2*(int)ceil(vd);
-    size_t is_size = (2*(n-1) + 2*(n-1)*n)*sizeof(GLuint);
-    GLuint buf;
-    glGenBuffers(1, &buf);
-    glBindBuffer(GL_ARRAY_BUFFER, buf);
-    glBufferData(GL_ARRAY_BUFFER, is_size, NULL, GL_STATIC_DRAW);
-    GLuint* is = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-    int i, j, front = 0;
-    for(i = 0; i < n-1; i++)
+    int limited = 0;
+    float* distances[] = {
+        &settings->graphics.viewdistance,
+        &settings->graphics.minviewdistance,
+        &settings->graphics.maxviewdistance
+    };
+    int i;
+    for(i = 0; i < 3; i++)
     {
-        is[front++] = i*n;
-        for(j = 0; j < n; j++)
-        {
-            is[front++] = i*n+j;
-            is[front++] = (i+1)*n+j;
-        }
-        is[front++] = (i+1)*n+n-1;
+        if(*distances[i] <= limit) continue;
+        *distances[i] = limit;
+        limited = 1;
     }
-    *count = front;
-    glUnmapBuffer(GL_ARRAY_BUFFER);
-    return buf;
+    return limited;
 }
 
 int main(int argc, char** argv)
 {
+    InitProfiler();
+    InitStartup();
+    SetProfileThreadName("Main");
+    InitLog();
     Settings settings;
     ConstructSettings(&settings);
+    int phase = BeginStartupPhase("LoadSettingsFile");
     LoadSettingsFile(&settings, "settings.ini");
+    EndStartupPhase(phase);
+    Settings file_settings = settings;
+    SetLogLevel(settings.log.level);
+    long frames = -1;
+    char screenshot = 0;
+    const char* benchmark_path = NULL;
+    const char* trace_path = NULL;
+    int arg;
+    for(arg = 1; arg < argc; arg++)
+    {
+        if(strcmp(argv[arg], "--headless") == 0)
+            settings.video.headless = 1;
+        else if(strcmp(argv[arg], "--frames") == 0 && arg + 1 < argc)
+            frames = atol(argv[++arg]);
+        else if(strcmp(argv[arg], "--screenshot") == 0)
+            screenshot = 1;
+        else if(strcmp(argv[arg], "--benchmark") == 0 && arg + 1 < argc)
+            benchmark_path = argv[++arg];
+        else if(strcmp(argv[arg], "--trace") == 0 && arg + 1 < argc)
+            trace_path = argv[++arg];
+        else if(strcmp(argv[arg], "--log") == 0 && arg + 1 < argc)
+        {
+            if(OpenLogFile(argv[++arg]) < 0)
+                Log(LOG_WARNING, "Could not open log file \"%s\".", argv[arg]);
+        }
+    }
+    //Nothing would ever wake a headless run or a benchmark up again.
+    if(settings.video.headless || benchmark_path) settings.video.idle = 0;
+    //A benchmark measures a fixed workload, so the view distance must not
+    //follow the frame time it is measuring.
+    if(benchmark_path && settings.graphics.autoviewdistance)
+    {
+        Log(LOG_INFO, "Benchmarking at the fixed view distance of %g, "
+                      "autoviewdistance is ignored.",
+            settings.graphics.viewdistance);
+        settings.graphics.autoviewdistance = 0;
+    }
+    phase = BeginStartupPhase("Init");
     if(Init(&settings) < 0) return -1;
+    EndStartupPhase(phase);
+    Log(LOG_INFO, "%s, OpenGL %s", (const char*)glGetString(GL_RENDERER),
+        (const char*)glGetString(GL_VERSION));
+    if(settings.graphics.programcache) SetProgramCache("shadercache");
+    //Let the driver compile shaders on as many threads as it likes.
+    if(GLAD_GL_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
 
-    GLuint program;
-    if(SetupProgram(&program) < 0) return -2;
-
-    GLuint grid_vbuf = CreateGridVertexBuffer(settings.graphics.viewdistance);
-    int grid_icount;
-    GLuint grid_ibuf = CreateGridIndexBuffer(&grid_icount,
-                                             settings.graphics.viewdistance);
-
-    glUseProgram(program);
-    GLint grid_pos_loc = glGetAttribLocation(program, "grid_pos");
-    GLint grid_world_mat_loc = glGetUniformLocation(program, "world_mat");
-    GLint grid_view_mat_loc = glGetUniformLocation(program, "view_mat");
-    GLint grid_proj_mat_loc = glGetUniformLocation(program, "proj_mat");
-    GLint grid_color_loc = glGetUniformLocation(program, "color");
-    GLint grid_viewdistance_loc = glGetUniformLocation(program, "viewdistance");
-
-    glUniform3f(grid_color_loc, 0.f, 0.6f, 0.f);
-    glUniform1f(grid_viewdistance_loc, settings.graphics.viewdistance);
-
-    GLuint grid_vao;
-    glGenVertexArrays(1, &grid_vao);
-    glBindVertexArray(grid_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, grid_vbuf);
-    glEnableVertexAttribArray(grid_pos_loc);
-    glVertexAttribPointer(grid_pos_loc, 2, GL_FLOAT, GL_FALSE, 0, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, grid_ibuf);
+    TerrainPath terrain_path = TERRAIN_INSTANCED;
+    if(settings.graphics.occlusionculling)
+    {
+        terrain_path = TERRAIN_OCCLUSION_CULLED;
+    }
+    else if(settings.graphics.tilecache && GLAD_GL_VERSION_3_2)
+    {
+        terrain_path = TERRAIN_CACHED;
+    }
+    else if(settings.graphics.tilebaking)
+    {
+        terrain_path = TERRAIN_BAKED;
+    }
+    else if(settings.graphics.gpuculling && GLAD_GL_VERSION_4_3 &&
+            !settings.graphics.horizonculling)
+    {
+        terrain_path = TERRAIN_GPU_CULLED;
+    }
+    else if(settings.graphics.multidraw && GLAD_GL_VERSION_4_3 &&
+            GLAD_GL_ARB_shader_draw_parameters)
+    {
+        terrain_path = TERRAIN_MULTIDRAW;
+    }
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glClearColor(0.5f, 0.5f, 0.5f, 1.f);
-    glViewport(0, 0, settings.video.width, settings.video.height);
+    //Every program is started before the rest of the setup and finished
+    //after it, so the driver can build them all in parallel meanwhile.
+    const char* terrain_vertex;
+    const char* terrain_defines;
+    GetTerrainShader(terrain_path, &terrain_vertex, &terrain_defines);
+    ProgramBuild terrain_build, far_build;
+    StartTerrainProgram(&terrain_build, terrain_vertex, terrain_defines);
+    char farfield = settings.graphics.farviewdistance > 0.f;
+    if(farfield) StartTerrainProgram(&far_build, "TerrainVertex.glsl", NULL);
+
+    float viewdistance_limit = MaxTerrainViewDistance(terrain_path);
+    if(LimitViewDistance(&settings, viewdistance_limit))
+    {
+        Log(LOG_WARNING, "The terrain path can't draw farther than %.0f, "
+            "the view distance is limited to that.", viewdistance_limit);
+    }
+    Governor governor;
+    ConstructGovernor(&governor, &settings);
+    float viewdistance = settings.graphics.autoviewdistance ?
+                         governor.viewdistance :
+                         settings.graphics.viewdistance;
 
+    Terrain terrain;
+    phase = BeginStartupPhase("ConstructTerrain");
+    ConstructTerrain(&terrain, viewdistance, terrain_path,
+                     settings.graphics.tilegenerator,
+                     settings.graphics.horizonculling);
+    EndStartupPhase(phase);
+
+    //Terrain beyond the view distance is drawn from a panorama, and the near
+    //terrain is fogged as if it reached all the way out.
+    Impostor impostor;
+    if(farfield)
+    {
+        phase = BeginStartupPhase("ConstructImpostor");
+        ConstructImpostor(&impostor, IMPOSTOR_SIZE,
+                          settings.graphics.farviewdistance,
+                          settings.graphics.impostormove,
+                          settings.graphics.impostorerror);
+        EndStartupPhase(phase);
+    }
+
+    Hud hud;
+    phase = BeginStartupPhase("ConstructHud");
+    ConstructHud(&hud, settings.graphics.frametimebudget);
+    EndStartupPhase(phase);
+
+    RenderState render_state;
+    ConstructRenderState(&render_state);
+    RenderQueue render_queue;
+    ConstructRenderQueue(&render_queue);
+
+    Capture capture;
+    phase = BeginStartupPhase("ConstructCapture");
+    char capturing = ConstructCapture(&capture,
+                                      settings.capture.png ? CAPTURE_PNG :
+                                                             CAPTURE_PPM,
+                                      settings.capture.fps) == 0;
+    EndStartupPhase(phase);
+    if(!capturing)
+    {
+        Log(LOG_WARNING, "Failed to start the capture thread. Screenshots "
+                         "and recording are disabled.");
+    }
+
+    Hierarchy scene;
+    ConstructHierarchy(&scene);
     Node grid_node;
-    ConstructNode(&grid_node);
+    ConstructNode(&grid_node, &scene);
     Camera camera;
-    ConstructCamera(&camera);
+    ConstructCamera(&camera, &scene);
     mat4x4 projection_matrix;
     mat4x4_perspective(projection_matrix,
                        settings.video.pfov,
                        settings.video.width/(float)settings.video.height,
                        settings.video.pnear,
                        settings.video.pfar);
-    glUniformMatrix4fv(grid_proj_mat_loc, 1, GL_FALSE,
-                       (const float*)projection_matrix);
 
+    GpuProfiler gpu;
+    ConstructGpuProfiler(&gpu);
+
+    //A benchmark that can't be loaded skips the main loop, but everything
+    //set up so far is still destroyed on the way out.
+    Benchmark benchmark;
+    char benchmarking = 0;
+    int result = 0;
+    if(benchmark_path)
+    {
+        int err = ConstructBenchmark(&benchmark, benchmark_path, &gpu);
+        if(err < 0)
+        {
+            char msg[256];
+            if(err == -1)
+            {
+                snprintf(msg, sizeof(msg), "Could not read at least two "
+                         "keyframes from \"%s\".", benchmark_path);
+            }
+            else
+            {
+                snprintf(msg, sizeof(msg), "Invalid keyframe on line %d of "
+                         "\"%s\".", -err - 1, benchmark_path);
+            }
+            Message("Error: Could not load benchmark.", msg);
+            result = -3;
+        }
+        else
+        {
+            benchmarking = 1;
+            UpdateBenchmark(&benchmark, &camera);
+            UpdateCamera(&camera);
+        }
+    }
+
+    //While the terrain program builds, the tiles around the camera get their
+    //height ranges so the first frames needn't spread them out.
+    phase = BeginStartupPhase("PrefetchTerrain");
+    while(!IsProgramReady(&terrain_build) &&
+          PrefetchTerrain(&terrain, GetNodePosition(&camera.node), 8) > 0);
+    EndStartupPhase(phase);
+
+    phase = BeginStartupPhase("FinishTerrain");
+    FinishTerrain(&terrain);
+    EndStartupPhase(phase);
+
+    //The terrain falls back to another path if its own can't be set up.
+    const char* vertex;
+    const char* defines;
+    GetTerrainShader(terrain.path, &vertex, &defines);
+    if(vertex != terrain_vertex || defines != terrain_defines)
+    {
+        FinishProgram(&terrain_build, NULL);
+        StartTerrainProgram(&terrain_build, vertex, defines);
+    }
+    GLuint program;
+    if(FinishProgram(&terrain_build, &program) < 0)
+    {
+        Message("Error: Could not set up the terrain shaders.",
+                "See the log for the compiler output.");
+        if(farfield)
+        {
+            FinishProgram(&far_build, NULL);
+            DestroyImpostor(&impostor);
+        }
+        DestroyHud(&hud);
+        if(benchmarking) DestroyBenchmark(&benchmark);
+        DestroyGpuProfiler(&gpu);
+        if(capturing) DestroyCapture(&capture);
+        DestroyRenderQueue(&render_queue);
+        DestroyTerrain(&terrain);
+        DestroyHierarchy(&scene);
+        return -2;
+    }
+
+    vec3 grid_color = { 0.f, 0.6f, 0.f };
+    GLint tiles_unit = 0;
+    GLuint far_program = 0;
+    if(farfield)
+    {
+        phase = BeginStartupPhase("FinishImpostor");
+        if(FinishProgram(&far_build, &far_program) < 0 ||
+           FinishImpostor(&impostor, far_program) < 0)
+        {
+            Log(LOG_WARNING, "Failed to set up the far terrain. Drawing "
+                             "the near terrain only.");
+            if(far_program) glDeleteProgram(far_program);
+            DestroyImpostor(&impostor);
+            far_program = 0;
+            farfield = 0;
+        }
+        else
+        {
+            SetUniform(&render_state, far_program, UNIFORM_VEC3,
+                       glGetUniformLocation(far_program, "color"),
+                       grid_color);
+            SetUniform(&render_state, far_program, UNIFORM_INT,
+                       glGetUniformLocation(far_program, "tiles"),
+                       &tiles_unit);
+            SetImpostorRange(&impostor, viewdistance);
+        }
+        EndStartupPhase(phase);
+    }
+    float fogdistance = farfield ? settings.graphics.farviewdistance :
+                                   viewdistance;
+
+    phase = BeginStartupPhase("FinishHud");
+    char hud_ready = FinishHud(&hud) == 0;
+    EndStartupPhase(phase);
+    char show_hud = settings.video.hud;
+    if(!hud_ready)
+    {
+        DestroyHud(&hud);
+        if(show_hud)
+            Log(LOG_WARNING, "Failed to set up the performance overlay.");
+    }
+
+    //The vertex arrays were bound outside of the render state.
+    InvalidateRenderState(&render_state);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glClearColor(0.5f, 0.5f, 0.5f, 1.f);
+    glViewport(0, 0, settings.video.width, settings.video.height);
+
+    GridUniforms grid;
+    UseGridProgram(&terrain, &render_state, program, &grid, grid_color,
+                   fogdistance, projection_matrix);
+
+    //Settings are applied again when settings.ini is saved, and the terrain
+    //programs are rebuilt when their shaders are, except during a
+    //benchmark, where they would make runs incomparable.
+    Watcher watcher;
+    ShaderReloader reloader;
+    unsigned int settings_file = 0;
+    char watching = !benchmark_path;
+    char reloading = 0;
+    int grid_reload = -1, far_reload = -1, heights_reload = -1;
+    if(watching)
+    {
+        ConstructWatcher(&watcher);
+        settings_file = WatchFile(&watcher, "settings.ini");
+        reloading = ConstructShaderReloader(&reloader) == 0;
+        if(!reloading)
+        {
+            Log(LOG_WARNING, "Failed to start the shader reloading thread. "
+                             "Saved shaders are not reloaded.");
+        }
+    }
+    if(reloading)
+    {
+        ShaderSource sources[] = {
+            { GL_VERTEX_SHADER, "Noise.glsl", NULL },
+            { GL_VERTEX_SHADER, vertex, defines },
+            { GL_FRAGMENT_SHADER, "Fragment.glsl", NULL }
+        };
+        grid_reload = AddReloadedProgram(&reloader, &watcher, "terrain", 3,
+                                         sources, 0, NULL);
+        sources[1].file = "TerrainVertex.glsl";
+        sources[1].defines = NULL;
+        if(farfield)
+        {
+            far_reload = AddReloadedProgram(&reloader, &watcher,
+                                            "far terrain", 3, sources, 0,
+                                            NULL);
+        }
+        //On the cached and baked paths, the heights come from a program of
+        //their own, and the tiles computed with the old one are redone.
+        ShaderSource height_sources[PROGRAM_MAX_SHADERS];
+        GLsizei varying_count;
+        const char** varyings;
+        GLsizei count = GetTerrainHeightSources(&terrain, height_sources,
+                                                &varying_count, &varyings);
+        if(count > 0)
+        {
+            heights_reload = AddReloadedProgram(&reloader, &watcher,
+                                                "terrain heights", count,
+                                                height_sources, varying_count,
+                                                varyings);
+        }
+    }
+
+    long frame = 0;
     float speed = 10.f;
     Uint32 ticks = SDL_GetTicks();
-    State state = STATE_RUNNING | (settings.video.fullscreen ? STATE_FULLSCREEN : 0);
+    Uint64 frame_start = SDL_GetPerformanceCounter();
+    float cputime = 0.f;
+    double startup = 0.;
+    char over_budget = 0;
+    phase = BeginStartupPhase("First frame");
+    State state = result < 0 ? 0 : STATE_RUNNING |
+                  (settings.video.fullscreen ? STATE_FULLSCREEN : 0);
     while(state & STATE_RUNNING)
     {
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glUseProgram(program);
-        glUniformMatrix4fv(grid_world_mat_loc, 1, GL_FALSE,
-                           (const float*)grid_node.world_matrix);
-        glUniformMatrix4fv(grid_view_mat_loc, 1, GL_FALSE,
-                           (const float*)camera.view_matrix);
-        glBindVertexArray(grid_vao);
-        glDrawElements(GL_TRIANGLE_STRIP, grid_icount, GL_UNSIGNED_INT, NULL);
-        SDL_GL_SwapWindow(window);
+        PROFILE_SCOPE("Frame");
+        SDL_bool changed = SDL_FALSE;
+        char viewdistance_changed = 0;
+        if(!(state & STATE_IDLE))
+        {
+            BeginGpuFrame(&gpu);
+            if(benchmarking) BeginBenchmarkFrame(&benchmark);
+            mat4x4 view_projection;
+            mat4x4_mul(view_projection, projection_matrix, camera.view_matrix);
+            ProfileScope update = BeginProfileScope("UpdateTerrain");
+            BeginGpuPass(&gpu, "Update");
+            UpdateTerrain(&terrain, &render_state,
+                          GetNodePosition(&camera.node), view_projection);
+            EndGpuPass(&gpu);
+            EndProfileScope(&update);
+            if(benchmarking)
+            {
+                TerrainStats tiles;
+                GetTerrainStats(&terrain, &tiles);
+                RecordBenchmarkTiles(&benchmark,
+                                     tiles.resident >= 0 ? tiles.pending : -1,
+                                     tiles.generate_time);
+            }
+            if(farfield)
+            {
+                PROFILE_SCOPE("UpdateImpostor");
+                int width, height;
+                GetFrameSize(&width, &height);
+                BeginGpuPass(&gpu, "Impostor");
+                UpdateImpostor(&impostor, &render_state,
+                               GetNodePosition(&camera.node),
+                               settings.video.pfov / height);
+                EndGpuPass(&gpu);
+            }
 
+            ProfileScope draw = BeginProfileScope("Draw");
+            BeginGpuPass(&gpu, "Terrain");
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            SetUniform(&render_state, program, UNIFORM_MAT4,
+                       grid.view_mat, camera.view_matrix);
+            SetUniform(&render_state, program, UNIFORM_MAT4,
+                       grid.world_mat, GetNodeWorldMatrix(&grid_node));
+            ClearRenderQueue(&render_queue);
+            SubmitTerrain(&terrain, &render_queue, program);
+            ExecuteRenderQueue(&render_queue, &render_state);
+            EndGpuPass(&gpu);
+            if(farfield)
+            {
+                BeginGpuPass(&gpu, "Far");
+                DrawImpostor(&impostor, &render_state, projection_matrix,
+                             camera.view_matrix);
+                EndGpuPass(&gpu);
+            }
+            BeginGpuPass(&gpu, "Occlusion");
+            TestTerrainOcclusion(&terrain, &render_state, view_projection);
+            EndGpuPass(&gpu);
+            if(show_hud && hud_ready)
+            {
+                int w, h;
+                GetFrameSize(&w, &h);
+                BeginGpuPass(&gpu, "HUD");
+                DrawHud(&hud, &render_state, w, h);
+                EndGpuPass(&gpu);
+            }
+            EndProfileScope(&draw);
+            frame++;
+            if(frame == frames)
+            {
+                if(screenshot && capturing) RequestScreenshot(&capture);
+                state &= ~STATE_RUNNING;
+            }
+            if(capturing)
+            {
+                PROFILE_SCOPE("CaptureFrame");
+                int w, h;
+                GetFrameSize(&w, &h);
+                BeginGpuPass(&gpu, "Capture");
+                CaptureFrame(&capture, w, h);
+                EndGpuPass(&gpu);
+            }
+            EndGpuFrame(&gpu);
+            if(benchmarking) EndBenchmarkFrame(&benchmark);
+            cputime = (SDL_GetPerformanceCounter() - frame_start) /
+                      (float)SDL_GetPerformanceFrequency();
+            ProfileScope swap = BeginProfileScope("Swap");
+            SwapFrame();
+            EndProfileScope(&swap);
+            if(frame == 1)
+            {
+                EndStartupPhase(phase);
+                startup = EndStartup();
+                float budget = settings.benchmark.startupbudget;
+                if(benchmarking && budget > 0.f && startup > budget)
+                {
+                    Log(LOG_ERROR, "The first frame took %.1f ms, over the "
+                                   "startup budget of %g ms.", startup,
+                        budget);
+                    over_budget = 1;
+                }
+            }
+            if(capturing) UpdateCapture(&capture);
+
+            Uint64 frame_end = SDL_GetPerformanceCounter();
+            float frametime = (frame_end - frame_start) /
+                              (float)SDL_GetPerformanceFrequency();
+            frame_start = frame_end;
+            if(benchmarking) FinishBenchmarkFrame(&benchmark, frametime);
+            if(hud_ready)
+            {
+                const GpuFrame* gpu_frame = GetGpuFrame(&gpu, gpu.last_frame);
+                HudStats stats;
+                stats.cputime = cputime;
+                stats.gputime = gpu_frame ? gpu_frame->time : -1.;
+                stats.triangles = gpu_frame ? gpu_frame->primitives : -1.;
+                GetTerrainStats(&terrain, &stats.terrain);
+                UpdateHud(&hud, frametime, &stats);
+            }
+            if(settings.graphics.autoviewdistance &&
+               UpdateGovernor(&governor, frametime))
+            {
+                viewdistance = governor.viewdistance;
+                viewdistance_changed = 1;
+                changed = SDL_TRUE;
+            }
+        }
+        else
+        {
+            //Nothing changed since the last frame was drawn, so wait for
+            //input instead of drawing the same image again.
+            SDL_WaitEventTimeout(NULL, IDLE_TIMEOUT);
+        }
+
+        ProfileScope events = BeginProfileScope("Events");
         SDL_Event event;
         while(SDL_PollEvent(&event))
         {
+            changed = SDL_TRUE;
             switch(event.type)
             {
             case SDL_QUIT:
@@ -176,6 +659,19 @@ int main(int argc, char** argv)
                 case SDL_SCANCODE_LSHIFT:
                     speed = settings.controls.speed1;
                     break;
+                case SDL_SCANCODE_F12:
+                    if(capturing) RequestScreenshot(&capture);
+                    break;
+                case SDL_SCANCODE_F9:
+                    if(capturing) ToggleRecording(&capture);
+                    break;
+                case SDL_SCANCODE_F3:
+                    show_hud = !show_hud;
+                    break;
+                case SDL_SCANCODE_F8:
+                    if(DumpProfile("trace.json") < 0)
+                        Log(LOG_WARNING, "Could not write trace.json.");
+                    break;
                 default:
                     break;
                 }
@@ -201,8 +697,9 @@ int main(int argc, char** argv)
                                        w/(float)h,
                                        settings.video.pnear,
                                        settings.video.pfar);
-                    glUniformMatrix4fv(grid_proj_mat_loc, 1, GL_FALSE,
-                                       (const float*)projection_matrix);
+                    SetUniform(&render_state, program, UNIFORM_MAT4,
+                               grid.proj_mat, projection_matrix);
+                    ResetGovernor(&governor);
                 }
                 break;
             case SDL_MOUSEMOTION:
@@ -218,10 +715,139 @@ int main(int argc, char** argv)
                 break;
             }
         }
+        unsigned int written = watching ? PollWatcher(&watcher) : 0;
+        if(reloading) ReloadShaders(&reloader, written);
+        if(written & settings_file)
+        {
+            Log(LOG_INFO, "Reloading settings.ini.");
+            Settings old = settings;
+            ReloadSettings(&settings, &file_settings);
+            LimitViewDistance(&settings, viewdistance_limit);
+            SetLogLevel(settings.log.level);
+            if(window && settings.video.fullscreen != old.video.fullscreen &&
+               settings.video.fullscreen != !!(state & STATE_FULLSCREEN))
+            {
+                state ^= STATE_FULLSCREEN;
+                SDL_SetWindowFullscreen
+                (
+                    window,
+                    state & STATE_FULLSCREEN ?
+                    SDL_WINDOW_FULLSCREEN_DESKTOP : 0
+                );
+            }
+            if(window && (settings.video.width != old.video.width ||
+                          settings.video.height != old.video.height))
+            {
+                SDL_SetWindowSize(window, settings.video.width,
+                                  settings.video.height);
+            }
+            if(window && settings.video.vsync != old.video.vsync &&
+               SetVSync(settings.video.vsync) < 0)
+            {
+                Log(LOG_WARNING, "Could not change vsync: %s",
+                    SDL_GetError());
+            }
+            if(settings.video.pfov != old.video.pfov ||
+               settings.video.pnear != old.video.pnear ||
+               settings.video.pfar != old.video.pfar)
+            {
+                int w, h;
+                GetFrameSize(&w, &h);
+                mat4x4_perspective(projection_matrix,
+                                   settings.video.pfov,
+                                   w/(float)h,
+                                   settings.video.pnear,
+                                   settings.video.pfar);
+                SetUniform(&render_state, program, UNIFORM_MAT4,
+                           grid.proj_mat, projection_matrix);
+            }
+            if(settings.video.hud != old.video.hud)
+                show_hud = settings.video.hud;
+            if(hud_ready)
+                hud.budget = settings.graphics.frametimebudget;
+            if(settings.graphics.viewdistance !=
+               old.graphics.viewdistance ||
+               settings.graphics.autoviewdistance !=
+               old.graphics.autoviewdistance ||
+               settings.graphics.frametimebudget !=
+               old.graphics.frametimebudget ||
+               settings.graphics.minviewdistance !=
+               old.graphics.minviewdistance ||
+               settings.graphics.maxviewdistance !=
+               old.graphics.maxviewdistance)
+            {
+                ConstructGovernor(&governor, &settings);
+                viewdistance = settings.graphics.autoviewdistance ?
+                               governor.viewdistance :
+                               settings.graphics.viewdistance;
+                viewdistance_changed = 1;
+            }
+            const Uint8* keys = SDL_GetKeyboardState(NULL);
+            speed = keys[SDL_SCANCODE_LSHIFT] ? settings.controls.speed2 :
+                                                settings.controls.speed1;
+            changed = SDL_TRUE;
+        }
+        //Programs rebuilt in the background replace the old ones between
+        //frames, once they are done.
+        GLuint reloaded = reloading ?
+                          TakeReloadedProgram(&reloader, grid_reload) : 0;
+        if(reloaded)
+        {
+            ForgetProgram(&render_state, program);
+            glDeleteProgram(program);
+            program = reloaded;
+            UseGridProgram(&terrain, &render_state, program, &grid,
+                           grid_color, fogdistance, projection_matrix);
+            changed = SDL_TRUE;
+        }
+        reloaded = reloading ? TakeReloadedProgram(&reloader, far_reload) : 0;
+        if(reloaded)
+        {
+            ForgetProgram(&render_state, far_program);
+            glDeleteProgram(far_program);
+            far_program = reloaded;
+            SetImpostorProgram(&impostor, far_program);
+            SetUniform(&render_state, far_program, UNIFORM_VEC3,
+                       glGetUniformLocation(far_program, "color"),
+                       grid_color);
+            SetUniform(&render_state, far_program, UNIFORM_INT,
+                       glGetUniformLocation(far_program, "tiles"),
+                       &tiles_unit);
+            changed = SDL_TRUE;
+        }
+        reloaded = reloading ? TakeReloadedProgram(&reloader, heights_reload) :
+                               0;
+        if(reloaded)
+        {
+            SetTerrainHeightProgram(&terrain, &render_state, reloaded);
+            changed = SDL_TRUE;
+        }
+        //Only the per-draw buffers depend on the view distance, and only
+        //grow.
+        if(viewdistance_changed)
+        {
+            SetTerrainViewDistance(&terrain, viewdistance);
+            if(farfield) SetImpostorRange(&impostor, viewdistance);
+            else
+            {
+                fogdistance = viewdistance;
+                SetUniform(&render_state, program, UNIFORM_FLOAT,
+                           grid.viewdistance, &fogdistance);
+            }
+        }
+        if(state & STATE_IDLE)
+        {
+            //Don't count the time spent waiting as frame time.
+            ticks = SDL_GetTicks();
+            frame_start = SDL_GetPerformanceCounter();
+        }
         Uint32 nticks = SDL_GetTicks();
         float delta = (nticks - ticks)/1000.f;
         ticks = nticks;
 
+        EndProfileScope(&events);
+
+        ProfileScope movement_scope = BeginProfileScope("Movement");
         const Uint8* keys = SDL_GetKeyboardState(NULL);
         vec3 movement;
         int i;
@@ -258,37 +884,79 @@ int main(int argc, char** argv)
             moved = SDL_TRUE;
         }
 
-        if(moved)
+        if(benchmarking)
+        {
+            //The path is flown at a fixed step per frame, whatever the
+            //frame time, so runs are comparable.
+            if(!UpdateBenchmark(&benchmark, &camera))
+                state &= ~STATE_RUNNING;
+        }
+        else if(moved)
         {
             vec3_norm(movement, movement);
             vec3_scale(movement, movement, delta * speed);
-            vec3_add(camera.node.translation, camera.node.translation,
+            vec3 translation;
+            vec3_add(translation, GetNodeTranslation(&camera.node),
                      movement);
+            SetNodeTranslation(&camera.node, translation);
         }
+        EndProfileScope(&movement_scope);
 
         UpdateCamera(&camera);
 
-        if(moved)
+        //Stay awake while the terrain still improves on its own, or the
+        //frozen image could keep tiles hidden by stale occlusion results.
+        if(settings.video.idle && !changed && !moved &&
+           !(capturing && CapturePending(&capture)) &&
+           !TerrainPending(&terrain))
+            state |= STATE_IDLE;
+        else state &= ~STATE_IDLE;
+    }
+
+    if(benchmarking)
+    {
+        static const char* path_names[] =
+        {
+            "instanced", "multidraw", "GPU culled", "occlusion culled",
+            "cached", "baked"
+        };
+        //The baked path falls back to the CPU generator if it must.
+        const char* path_name = path_names[terrain.path];
+        if(terrain.path == TERRAIN_BAKED)
         {
-            vec2 tmp1;
-            tmp1[0] = camera.node.position[0];
-            tmp1[1] = camera.node.position[2];
-            vec2 tmp2;
-            tmp2[0] = grid_node.position[0];
-            tmp2[1] = grid_node.position[2];
-            vec2_sub(tmp1, tmp1, tmp2);
-            tmp1[0] = floor(tmp1[0]);
-            tmp1[1] = floor(tmp1[1]);
-            grid_node.translation[0] += tmp1[0];
-            grid_node.translation[2] += tmp1[1];
-            UpdateNode(&grid_node);
+            path_name = terrain.heights.generator.backend == GENERATOR_CPU ?
+                        "CPU baked" : "GPU baked";
         }
+        char description[256];
+        snprintf(description, sizeof(description),
+                 "%s, %s terrain, view distance %g, far view distance %g, "
+                 "first frame after %.0f ms",
+                 (const char*)glGetString(GL_RENDERER),
+                 path_name,
+                 viewdistance, settings.graphics.farviewdistance, startup);
+        ReportBenchmark(&benchmark, description);
+        DestroyBenchmark(&benchmark);
+    }
+    if(reloading) DestroyShaderReloader(&reloader);
+    if(watching) DestroyWatcher(&watcher);
+    if(hud_ready) DestroyHud(&hud);
+    DestroyGpuProfiler(&gpu);
+    if(capturing) DestroyCapture(&capture);
+    if(trace_path && DumpProfile(trace_path) < 0)
+        Log(LOG_WARNING, "Could not write the trace.");
+    DestroyRenderQueue(&render_queue);
+    DestroyTerrain(&terrain);
+    if(farfield)
+    {
+        DestroyImpostor(&impostor);
+        glDeleteProgram(far_program);
     }
-
-    glDeleteVertexArrays(1, &grid_vao);
-    glDeleteBuffers(1, &grid_vbuf);
-    glDeleteBuffers(1, &grid_ibuf);
     glDeleteProgram(program);
+    DestroyHierarchy(&scene);
+    DestroyProfiler();
+    DestroyLog();
 
-    return 0;
+    //A benchmark that started too slowly fails, for scripts to notice.
+    if(result == 0 && over_budget) result = -4;
+    return result;
 }